@@ -0,0 +1,271 @@
+#include <Arduino.h>
+#include <XPLDevices.h>
+
+// This sample measures the time needed by the input backends and prints the results to the serial port.
+// It does not connect to XPlane. Requires SHIFTIN_MAX_NUMBER >= 4 (set in platformio.ini), the keyboard matrix
+// is measured when MATRIX_MAX_ROWS >= 8, the hardware SPI output with SHIFTOUT_SPI. Nothing may be connected to A14.
+
+// Number of calls per measurement
+#define BENCH_LOOPS 100
+
+// Two independent input scanners, so each backend is measured on its own
+DigitalIn_ muxIn;
+DigitalIn_ shiftIn;
+#if MATRIX_MAX_ROWS >= 8
+// 8 x 10 keyboard matrix (CDU keypad), scanned completely and 2 rows per handle()
+DigitalIn_ matrixIn;
+DigitalIn_ matrixInc;
+const uint8_t matrixRows[] = {42, 43, 44, 45, 46, 47, 48, 49};
+const uint8_t matrixCols[] = {A0, A1, A2, A3, A4, A5, A6, A7, A8, A9};
+#endif
+
+// 8 encoders on channel pairs of MUX0 of the global DigitalIn, handled one by one and as a bank
+Encoder enc[8] = {
+  Encoder(0, 0, 1, NOT_USED, enc4Pulse), Encoder(0, 2, 3, NOT_USED, enc4Pulse),
+  Encoder(0, 4, 5, NOT_USED, enc4Pulse), Encoder(0, 6, 7, NOT_USED, enc4Pulse),
+  Encoder(0, 8, 9, NOT_USED, enc4Pulse), Encoder(0, 10, 11, NOT_USED, enc4Pulse),
+  Encoder(0, 12, 13, NOT_USED, enc4Pulse), Encoder(0, 14, 15, NOT_USED, enc4Pulse)};
+EncoderBank encBank(0, enc4Pulse);
+
+// 16 buttons on MUX0, handled one by one and as a bank
+Button btn[16] = {
+  Button(0, 0), Button(0, 1), Button(0, 2), Button(0, 3), Button(0, 4), Button(0, 5), Button(0, 6), Button(0, 7),
+  Button(0, 8), Button(0, 9), Button(0, 10), Button(0, 11), Button(0, 12), Button(0, 13), Button(0, 14), Button(0, 15)};
+ButtonBank btnBank(0);
+
+// Two analog inputs at A15, linear and with a response curve. The time of a conversion is subtracted, so the
+// result is the evaluation (scaling, curve and filter) of one sample.
+AnalogIn axisLinear(A15, unipolar, 4.0);
+AnalogIn axisCurve(A15, unipolar, 4.0);
+// throttle with idle detent at 0.4 and a flat climb detent at 0.8
+const int16_t throttleCurve[9] PROGMEM = {0, 4096, 8192, 13107, 13107, 19661, 26214, 26214, 32767};
+
+// Filter accuracy: A14 (nothing connected) is switched between pullup and driven low for full scale steps,
+// value() of each time constant is compared with a float reference of the filter. Build with and without
+// ANALOGIN_FIXED_POINT to compare both paths.
+#define STEP_PIN A14
+#define STEP_SAMPLES 200
+const float stepTimeConst[4] = {0.0, 2.0, 10.0, 100.0};
+AnalogIn axisStep[4] = {
+  AnalogIn(STEP_PIN, bipolar, stepTimeConst[0]), AnalogIn(STEP_PIN, bipolar, stepTimeConst[1]),
+  AnalogIn(STEP_PIN, bipolar, stepTimeConst[2]), AnalogIn(STEP_PIN, bipolar, stepTimeConst[3])};
+
+// 64 outputs on 74HC595, bit-banged on data pin 26, clock pin 27, latch pin 28 and on hardware SPI, latch pin 29
+ShiftOut outBitBang(26, 27, 28, 64);
+#if SHIFTOUT_SPI
+ShiftOut outSPI(SPI_PIN, SPI_PIN, 29, 64);
+#endif
+
+// 256 outputs as one chain and as four chains of 64 clocked in parallel (data pins 6-9, all on PORTH),
+// clock pin 16, latch pin 17
+ShiftOutN<256> outLong(6, 16, 17, 256);
+ShiftOutN<256, 4> outParallel(6, 16, 17, 64);
+
+// Print result of one measurement
+void report(const char *name, unsigned long time, uint16_t inputs)
+{
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print((float)time / BENCH_LOOPS);
+  Serial.print(" us per scan, ");
+  Serial.print((float)inputs * BENCH_LOOPS / time, 3);
+  Serial.println(" inputs/us");
+}
+
+// Print per encoder cost
+void reportEncoder(const char *name, unsigned long time)
+{
+  float perEncoder = (float)time / BENCH_LOOPS / 8;
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(perEncoder);
+  Serial.print(" us per encoder, ");
+  Serial.print((long)(1000.0 / perEncoder));
+  Serial.println(" encoders per ms of loop time");
+}
+
+// Print largest deviation of the filters from the float reference over 4 steps
+void reportAccuracy()
+{
+  float ref[4] = {0.0, 0.0, 0.0, 0.0};
+  float worst[4] = {0.0, 0.0, 0.0, 0.0};
+  for (uint16_t i = 0; i < 4 * STEP_SAMPLES; i++)
+  {
+    if ((i / STEP_SAMPLES) & 1)
+    {
+      pinMode(STEP_PIN, OUTPUT);
+      digitalWrite(STEP_PIN, LOW);
+    }
+    else
+    {
+      pinMode(STEP_PIN, INPUT_PULLUP);
+    }
+    for (uint8_t a = 0; a < 4; a++)
+    {
+      axisStep[a].handle();
+      int raw = axisStep[a].raw();
+      float x = (raw >= 0) ? raw / 511.0 : raw / 512.0;       // default range, center 512
+      float k = (stepTimeConst[a] > 0) ? 1.0 / stepTimeConst[a] : 1.0;
+      ref[a] = k * x * 100.0 + (1.0 - k) * ref[a];
+      float deviation = fabs(axisStep[a].value() - ref[a]) / 100.0;
+      if (deviation > worst[a])
+      {
+        worst[a] = deviation;
+      }
+    }
+  }
+  pinMode(STEP_PIN, INPUT);
+  for (uint8_t a = 0; a < 4; a++)
+  {
+    Serial.print(ANALOGIN_FIXED_POINT ? "Fixed point" : "Float");
+    Serial.print(" time const ");
+    Serial.print(stepTimeConst[a], 0);
+    Serial.print(": max deviation ");
+    Serial.print(worst[a] * 1000000.0, 1);
+    Serial.println(" ppm of scale");
+  }
+}
+
+// Arduino setup function, called once
+void setup() {
+  Serial.begin(115200);
+
+  // 4 74HC4067 multiplexers on SimVim pins, 64 inputs
+  muxIn.setMux(22, 23, 24, 25);
+  muxIn.addMux(38);
+  muxIn.addMux(39);
+  muxIn.addMux(40);
+  muxIn.addMux(41);
+
+  // 8 74HC165 on data pin 30, clock pin 31, load pin 32, 64 inputs
+  shiftIn.addShiftIn(30, 31, 32, 8);
+
+#if MATRIX_MAX_ROWS >= 8
+  matrixIn.addMatrix(matrixRows, 8, matrixCols, 10);
+  matrixInc.addMatrix(matrixRows, 8, matrixCols, 10, 5, 2);
+#endif
+
+  // MUX0 for the encoders
+  DigitalIn.setMux(22, 23, 24, 25);
+  DigitalIn.addMux(38);
+
+  axisCurve.setCurve(throttleCurve, 3);
+  for (uint8_t a = 0; a < 4; a++) axisStep[a].setScale(100.0);
+
+  outParallel.addChain(7, 64);
+  outParallel.addChain(8, 64);
+  outParallel.addChain(9, 64);
+}
+
+// Arduino loop function, called cyclic
+void loop() {
+  unsigned long start;
+
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++) muxIn.handle();
+  report("74HC4067", micros() - start, 64);
+
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++) shiftIn.handle();
+  report("74HC165 ", micros() - start, 64);
+
+#if MATRIX_MAX_ROWS >= 8
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++) matrixIn.handle();
+  report("Matrix   ", micros() - start, 80);
+
+  // incremental scan: time per handle() is the per loop budget, a complete image takes 4 calls
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++) matrixInc.handle();
+  report("Matrix/2 ", micros() - start, 20);
+  Serial.print("Matrix ghosting detected: ");
+  Serial.println(matrixIn.matrixGhosts());
+#endif
+
+  // Encoder::handle() polls the multiplexer directly for each encoder
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++)
+  {
+    for (int e = 0; e < 8; e++) enc[e].handle();
+  }
+  reportEncoder("Encoder    ", micros() - start);
+
+  // EncoderBank decodes from the process image, including the time to scan it
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++)
+  {
+    DigitalIn.handle();
+    encBank.handle();
+  }
+  reportEncoder("EncoderBank", micros() - start);
+
+  // Buttons evaluate the process image only, so the scan is excluded here
+  DigitalIn.handle();
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++)
+  {
+    for (int b = 0; b < 16; b++) btn[b].handle();
+  }
+  report("Button x16 ", micros() - start, 16);
+
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++) btnBank.handle();
+  report("ButtonBank ", micros() - start, 16);
+
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++) analogRead(A15);
+  unsigned long conversion = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++) axisLinear.handle();
+  report("Analog linear", micros() - start - conversion, 1);
+
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++) axisCurve.handle();
+  report("Analog curve ", micros() - start - conversion, 1);
+
+  reportAccuracy();
+
+  // chain update: bit-banging blocks interrupts for one byte at a time, SPI only while starting the transfer
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++)
+  {
+    outBitBang.setPin(0, i & 1);
+    outBitBang.handle();
+  }
+  report("ShiftOut     ", micros() - start, 64);
+
+#if SHIFTOUT_SPI
+  unsigned long waiting = 0;
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++)
+  {
+    outSPI.setPin(0, i & 1);
+    outSPI.handle();
+    unsigned long wait = micros();
+    while (ShiftSPI.busy());
+    waiting += micros() - wait;
+  }
+  unsigned long total = micros() - start;
+  report("ShiftOut SPI ", total, 64);
+  report("SPI start    ", total - waiting, 64);
+#endif
+
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++)
+  {
+    outLong.setPin(0, i & 1);
+    outLong.handle();
+  }
+  report("ShiftOut 256 ", micros() - start, 256);
+
+  start = micros();
+  for (int i = 0; i < BENCH_LOOPS; i++)
+  {
+    outParallel.setPin(0, i & 1);
+    outParallel.handle();
+  }
+  report("ShiftOut 4x64", micros() - start, 256);
+
+  delay(2000);
+}
@@ -46,6 +46,9 @@ void loop() {
   // Handle XPlane interface
   XP.xloop();
 
+  // Read all expanders and sample the time base for debouncing
+  DigitalIn.handle();
+
   // handle all devices and automatically process commandsin background
   btnStart.handleXP();
   encHeading.handleXP();
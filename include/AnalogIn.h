@@ -1,9 +1,78 @@
 #ifndef AnalogIn_h
 #define AnalogIn_h
 #include <Arduino.h>
+#include <DigitalIn.h>
 
 #define AD_RES 10
 
+/// @brief Filter and scale in fixed point instead of float (much faster on AVR without FPU). Samples are
+/// normalized to Q15 and filtered in Q30, value() then needs one float multiply. Deviation from the float
+/// path is below 5e-5 of the scale for settled values; with long filter time constants transients deviate
+/// up to 3e-4 due to the Q16 filter constant.
+#ifndef ANALOGIN_FIXED_POINT
+#define ANALOGIN_FIXED_POINT 0
+#endif
+
+/// @brief Sample all analog inputs in the background: the ADC conversion complete interrupt cycles through all
+/// AnalogIn channels, including those on multiplexers, and stores the results, handle() then only filters the
+/// latest sample (AVR only)
+#ifndef ANALOGIN_SEQUENCER
+#define ANALOGIN_SEQUENCER 0
+#endif
+#if ANALOGIN_SEQUENCER && !defined(ARDUINO_ARCH_AVR)
+#error "ANALOGIN_SEQUENCER is only supported on AVR"
+#endif
+
+/// @brief Maximum number of direct analog inputs sampled by the sequencer (multiplexed inputs are not counted)
+#ifndef ANALOGIN_MAX_NUMBER
+#define ANALOGIN_MAX_NUMBER 8
+#endif
+
+/// @brief Store calibrations (min, max, center) in EEPROM, keyed by analog pin and multiplexer channel.
+/// Stored calibrations are loaded by the constructor. calibrate(), range changes of the automatic calibration and
+/// saveCalibration() write them back in the background, one byte per handle() and at most every
+/// ANALOGIN_EEPROM_INTERVAL ms. Ranges below a quarter of full scale are neither stored nor loaded (AVR only)
+#ifndef ANALOGIN_USE_EEPROM
+#define ANALOGIN_USE_EEPROM 0
+#endif
+#if ANALOGIN_USE_EEPROM && !defined(ARDUINO_ARCH_AVR)
+#error "ANALOGIN_USE_EEPROM is only supported on AVR"
+#endif
+
+/// @brief First EEPROM address used for calibrations
+#ifndef ANALOGIN_EEPROM_ADDRESS
+#define ANALOGIN_EEPROM_ADDRESS 0
+#endif
+
+/// @brief Number of calibrations in EEPROM (max. 32, 9 bytes each)
+#ifndef ANALOGIN_EEPROM_SLOTS
+#define ANALOGIN_EEPROM_SLOTS 16
+#endif
+#if ANALOGIN_EEPROM_SLOTS > 32
+#error "ANALOGIN_EEPROM_SLOTS must not exceed 32"
+#endif
+
+/// @brief Minimum interval between two EEPROM writes of the same calibration in ms
+#ifndef ANALOGIN_EEPROM_INTERVAL
+#define ANALOGIN_EEPROM_INTERVAL 10000
+#endif
+
+/// @brief Maximum number of analog inputs on 74HC4067 multiplexers
+#ifndef ANALOGIN_MUX_MAX_NUMBER
+#define ANALOGIN_MUX_MAX_NUMBER 32
+#endif
+
+/// @brief Dataref binding of an analog input
+struct AnalogValue_t
+{
+  float value;        // last value handed to XPLDirect
+  float band;         // deadband in value units
+  uint16_t counts;    // deadband in raw digits
+  int16_t raw;        // raw of the last sample
+  uint16_t still;     // samples since raw changed
+  uint16_t settle;    // samples until a resting input is sent
+};
+
 enum Analog_t
 {
   unipolar,
@@ -25,43 +94,202 @@ public:
   /// @param timeConst Filter time constant (t_filter/t_sample)
   AnalogIn(uint8_t pin, Analog_t type, float timeConst);
 
-  /// @brief Read analog input, scale value and perform filtering, call once per sample loop
+  /// @brief Setup analog input on a 74HC4067 multiplexer. The multiplexers share the selector pins set with
+  /// DigitalIn.setMux(), the data pin of the multiplexer is connected to an analog pin.
+  /// Conversions are done by handleMux() or the sequencer, handle() then only filters the latest sample.
+  /// @param pin Analog pin the multiplexer is connected to
+  /// @param muxChannel Channel on the multiplexer (0-15)
+  /// @param type unipolar (0..1) or bipolar (-1..1)
+  /// @param timeConst Filter time constant (t_filter/t_sample), 0 = no filter
+  AnalogIn(uint8_t pin, uint8_t muxChannel, Analog_t type, float timeConst = 0.0);
+
+  /// @brief Read analog input, scale value and perform filtering, call once per sample loop.
+  /// value() changes with each new (decimated) sample only, it stays 0 until the first sample is complete.
   void handle();
 
+  /// @brief Convert all analog inputs on multiplexers, call once per sample loop before handle().
+  /// Blocks until all inputs are converted (about 110 us per input, without overlap of switching and converting);
+  /// only the sequencer avoids the blocking reads, handleMux() returns at once while it is running.
+  /// A conversion during which the background scan of DigitalIn switched the selector pins is repeated up to
+  /// 3 times, then taken anyway.
+  static void handleMux();
+
   /// @brief Return actual value
   /// @return Actual, filtered value as captured with handle()
+#if ANALOGIN_FIXED_POINT
+  float value() { return _filtered * _outScale; };
+#else
   float value() { return _value; };
+#endif
 
   /// @brief Return raw value
-  /// @return Read raw analog input and compensate bipolta offset
+  /// @return Latest (decimated) sample as captured with handle(), bipolar offset compensated.
+  /// Resolution is AD_RES + oversampling bits.
   int raw();
 
+  /// @brief Set oversampling with decimation for finer resolution and less noise. 4^bits conversions are
+  /// accumulated per sample (one per handle(), or in the background when the sequencer is running),
+  /// the sum is decimated to AD_RES + bits. Range and calibration are kept.
+  /// @param bits Additional bits of resolution (0-5)
+  void setOversampling(uint8_t bits);
+
+  /// @brief Get the resolution of the samples
+  /// @return Effective resolution in bits
+  uint8_t effectiveBits() { return AD_RES + _osBits; };
+
+  /// @brief Get the measured rate of (decimated) samples
+  /// @return Samples per second, 0 until two samples have been taken
+  float sampleRate() { return _samplePeriod ? 1000000.0 / _samplePeriod : 0.0; };
+
   /// @brief Perform calibration for bipolar input, current position gets center and min/max ranges 
   /// are adapted to cover +/- scale. Usage is only sensible for small deviations like for joysticks.
+  /// Does not block: the next 64 samples are averaged by handle().
   void calibrate();
 
+  /// @brief Check for a calibration in progress
+  /// @return true until the calibration started with calibrate() is complete
+  bool calibrating() { return _calCount > 0; };
+
+  /// @brief Track the range in the background: min and max follow extremes reached by several samples in a row
+  /// (single noise spikes are ignored), the center of a bipolar input follows slow drift while the input rests
+  /// close to it with little noise. Without a stored calibration the range starts at the first sample (taken as
+  /// center), so each axis has to be moved to its limits once.
+  /// @param enable true to track, false to keep the current range
+  void setAutoCalibrate(bool enable);
+
+  /// @brief Store the current calibration in EEPROM (in the background, needs ANALOGIN_USE_EEPROM). Center drift
+  /// followed by the automatic calibration is only stored with the next range change or by this call.
+  void saveCalibration();
+
+  /// @brief Check for a stored calibration
+  /// @return true when a calibration has been loaded from EEPROM or calibrate() / automatic calibration have run
+  bool calibrated() { return _calValid; };
+
+#if ANALOGIN_SEQUENCER
+  /// @brief Start background sampling of all analog inputs, reference is AVcc.
+  /// analogRead() must not be used while the sequencer is running.
+  /// @return true when started, false when no analog input is defined
+  static bool startSequencer();
+
+  /// @brief Stop background sampling after the current conversion, raw() uses analogRead() again and
+  /// multiplexed inputs need handleMux()
+  static void stopSequencer();
+
+  /// @brief Store conversion result and start the next channel, called from ADC interrupt
+  static void sequencerISR();
+#endif
+
   /// @brief Set subrange for mechanically limited potentiometers and limit output value to this range.
   /// for bipolar applications the offset is set to the center value of this range.
-  /// @param min Minimum value in raw digits (maps to Zero)
-  /// @param max Maximum value in raw digits (maps to Scale)
+  /// Overrides a calibration loaded from EEPROM.
+  /// @param min Minimum value in raw digits of AD_RES bits (maps to Zero)
+  /// @param max Maximum value in raw digits of AD_RES bits (maps to Scale)
   void setRange(uint16_t min, uint16_t max);
 
   /// @brief Set output scale for max input range. Default scale is 1.0
   /// @param scale Scale of output value for maximum range
   void setScale(float scale);
 
+  /// @brief Set a piecewise linear response curve (detents, reversed ranges, non linear trim). The curve maps the
+  /// input range (unipolar 0..1, bipolar -1..1) to the output range in 2^segmentsLog2 segments of equal width,
+  /// it is evaluated with a shift for the segment lookup and an integer interpolation and applied before the filter.
+  /// Example: const int16_t throttle[] PROGMEM = {0, 12000, 16384, 16384, 32767}; in.setCurve(throttle, 2);
+  /// @param points Table of 2^segmentsLog2 + 1 points in PROGMEM, Q15 of the scale (32767 = scale, -32767 = -scale),
+  /// NULL for the linear response
+  /// @param segmentsLog2 Number of segments as power of 2 (0-8)
+  /// @return true when successful, false when segmentsLog2 is out of range
+  bool setCurve(const int16_t *points, uint8_t segmentsLog2);
+
+  /// @brief Bind the input to a writable dataref. The value is only updated (and sent) when it moved by more
+  /// than the deadband since the last update, so a jittering potentiometer does not load the serial link.
+  /// The final value of a smaller move is sent when the input reaches the end of its range or comes to rest.
+  /// @param dataRefName Name of the dataref
+  /// @param deadband Deadband in raw digits of AD_RES bits, 0 sends every change
+  /// @param index Index for array datarefs, -1 for plain datarefs
+  /// @return true when successful, false when the dataref could not be registered
+  bool setDataRef(XPString_t *dataRefName, uint16_t deadband = 2, int index = -1);
+
 private:
   void _calcScales();
+  void _calcDeadband();
+  void _updateDataRef();
+  AnalogValue_t *_dataRef;
+  void _update(int raw);
+  int16_t _applyCurve(int16_t x);
+  const int16_t *_curve;
+  uint8_t _curveShift;
+#if ANALOGIN_FIXED_POINT
+  int32_t _filtered;      // Q30
+  float _outScale;        // scale / (32767 * 2^15)
+  uint32_t _kPos;         // raw -> Q15, Q16 factor
+  uint32_t _kNeg;
+  uint16_t _filterK;      // Q16, 0 = no filter
+#else
   float _value;
-  float _filterConst;
-  float _scale;
   float _scalePos;
   float _scaleNeg;
+  float _curveIn;         // value -> Q15
+  float _curveOut;        // Q15 -> value
+#endif
+  float _filterConst;
+  float _scale;
   uint16_t _offset;
   uint16_t _min;
   uint16_t _max;
   uint8_t _pin;
   Analog_t _type;  
+  uint16_t _read();
+  bool _acquire();
+  bool _accumulate(uint16_t conversion);
+  void _track(uint16_t sample);
+  void _calChanged(bool store);
+  uint8_t _calCount;
+  uint32_t _calSum;
+  bool _calValid;
+  bool _tracking;
+  int8_t _beyond;         // consecutive samples above (> 0) or below (< 0) the range
+  uint16_t _candidate;    // range limit reached by all samples of the run
+  uint8_t _restCount;
+  uint8_t _restBlocks;
+  uint16_t _restMin;
+  uint16_t _restMax;
+  uint32_t _restSum;
+#if ANALOGIN_USE_EEPROM
+  void _loadCalibration();
+  void _saveCalibration();
+  uint8_t _calSlot;
+  bool _calDirty;
+  uint32_t _calSaved;
+  static AnalogIn *_calWriter;
+  static uint8_t _calBuffer[];
+  static uint8_t _calIndex;
+  static uint32_t _calClaimed;
+#endif
+  void _addMux();
+  uint8_t _muxChannel;
+  volatile bool _fresh;
+  static AnalogIn *_mux[ANALOGIN_MUX_MAX_NUMBER];
+  static uint8_t _numMux;
+#ifdef ARDUINO_ARCH_AVR
+  static void _selectChannel(uint8_t channel);
+  uint8_t _channel;
+#endif
+  uint8_t _osBits;
+  volatile uint16_t _accCount;
+  volatile uint16_t _sample;
+  volatile uint32_t _acc;
+  uint32_t _lastSample;
+  uint32_t _samplePeriod;
+#if ANALOGIN_SEQUENCER
+  static AnalogIn *_sequence(uint8_t index);
+  static void _startConversion(AnalogIn *in);
+  static AnalogIn *_slot[ANALOGIN_MAX_NUMBER];
+  static uint8_t _numSlots;
+  static volatile uint8_t _current;
+  static volatile bool _running;
+  static uint8_t _muxChanges;     // selector pin changes when the running conversion was started
+  static uint8_t _retries;        // repeated conversions of the current multiplexed input
+#endif
 };
 
 #endif
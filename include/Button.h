@@ -2,6 +2,30 @@
 #define Button_h
 #include <Arduino.h>
 #include <DigitalIn.h>
+#include <InputEvents.h>
+#include <directIO.h>
+
+/// @brief Hold time in ms until a long press is detected
+#ifndef GESTURE_LONG
+#define GESTURE_LONG 600
+#endif
+
+/// @brief Maximum time in ms between release and second press of a double click
+#ifndef GESTURE_DOUBLE
+#define GESTURE_DOUBLE 250
+#endif
+
+/// @brief Initial hold repeat interval in ms (max. 255)
+#ifndef GESTURE_REPEAT_START
+#define GESTURE_REPEAT_START 250
+#endif
+
+/// @brief Final hold repeat interval in ms, every repeat closes 1/4 of the remaining gap to it
+#ifndef GESTURE_REPEAT_MIN
+#define GESTURE_REPEAT_MIN 40
+#endif
+static_assert(GESTURE_REPEAT_START <= 255, "GESTURE_REPEAT_START must fit the 8 bit repeat interval");
+static_assert(GESTURE_REPEAT_MIN <= GESTURE_REPEAT_START, "GESTURE_REPEAT_MIN must not exceed GESTURE_REPEAT_START");
 
 /// @brief Class for a simple pushbutton with debouncing and XPLDirect command handling.
 /// Supports start and end of commands so XPlane can show the current Button status.
@@ -59,19 +83,30 @@ public:
   int getCommand()              { return _cmdPush; };
 
   /// @brief Process all transitions and active transitions to XPLDirect   
-  void processCommand();
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+  /// @brief Queue transitions in InputEvents as soon as handle() detects them, so none is collapsed
+  /// and each event carries the time of its detection. processCommand() and queueCommand() are not needed then.
+  /// @param enable true: queue mode, false: keep transitions for processCommand() or queueCommand()
+  void setQueueMode(bool enable) { _queued = enable; };
 
 protected:
+  void _processCommand(bool queue);
   enum
   {
     transNone,
     transPressed,
     transReleased
   };
+  void _update(bool input);
   uint8_t _nExp;
   uint8_t _pin;
-  uint8_t _state;
+  Debounce_t _state;
   uint8_t _transition;
+  bool _queued;
   int _cmdPush;
 };
 
@@ -115,4 +150,201 @@ protected:
   uint32_t _timer;
 };
 
+/// @brief Gestures detected by GestureButton
+enum Gesture_t
+{
+  gestNone = -1,
+  gestClick,          ///< short press and release
+  gestDouble,         ///< two clicks within GESTURE_DOUBLE
+  gestLong,           ///< held for GESTURE_LONG
+  gestRepeat          ///< still held after long press, accelerating from GESTURE_REPEAT_START to GESTURE_REPEAT_MIN
+};
+
+/// @brief Class for a pushbutton with gesture detection: click, double click, long press and accelerating
+/// hold repeat, each mapped to its own XPLDirect command. All timing uses the time base sampled by
+/// DigitalIn.handle(), which has to be called once per loop.
+class GestureButton : public Button
+{
+private:
+  void _handle(bool input);
+
+public:
+  /// @brief Constructor, set Expander and Channel number
+  /// @param nExp Expander number (from initialization order)
+  /// @param nChannel Channel on the IO expander (0-15)
+  /// @param doubleClick Detect double clicks. Single clicks are then reported after GESTURE_DOUBLE.
+  /// Also enabled by setting a command for gestDouble.
+  GestureButton(uint8_t nExp, uint8_t nChannel, bool doubleClick = false);
+
+  /// @brief Constructor, set digital input without Expander
+  /// @param pin Arduino pin number
+  /// @param doubleClick Detect double clicks
+  GestureButton(uint8_t pin, bool doubleClick = false) : GestureButton(NOT_USED, pin, doubleClick){};
+
+  /// @brief Handle realtime. Read input and evaluate any gestures.
+  void handle()                 { _handle(true); };
+
+  /// @brief Handle realtime. Read input and evaluate any gestures.
+  /// @param input Additional mask bit. AND connected with physical input.
+  void handle(bool input)       { _handle(input); };
+
+  /// @brief Handle realtime and process XPLDirect commands
+  void handleXP()               { _handle(true); processCommand(); };
+
+  /// @brief Handle realtime and process XPLDirect commands
+  /// @param input Additional mask bit. AND tied with physical input.
+  void handleXP(bool input)     { _handle(input); processCommand(); };
+
+  /// @brief Evaluate and reset the last detected gesture
+  /// @return Detected gesture or gestNone
+  Gesture_t gesture()           { Gesture_t g = (Gesture_t)_gesture; _gesture = gestNone; return g; };
+
+  /// @brief Set XPLDirect command for a gesture
+  /// @param gesture Gesture to map
+  /// @param cmd Command handle as returned by XP.registerCommand()
+  void setCommand(Gesture_t gesture, int cmd);
+
+  /// @brief Set XPLDirect command for a gesture
+  /// @param gesture Gesture to map
+  /// @param cmdName Command name to register
+  void setCommand(Gesture_t gesture, XPString_t *cmdName);
+
+  /// @brief Get XPLDirect command associated with a gesture
+  /// @param gesture Gesture
+  /// @return Handle of the command, -1 for gestNone
+  int getCommand(Gesture_t gesture) { return (gesture == gestNone) ? -1 : _cmd[gesture]; };
+
+  /// @brief Trigger the command of the last detected gesture
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+protected:
+  void _processCommand(bool queue);
+  enum
+  {
+    gsIdle,           // released
+    gsPressed,        // pressed, no gesture yet
+    gsReleased,       // released after click, waiting for second press
+    gsHeld,           // gesture reported, waiting for release
+    gsRepeat          // hold repeat active
+  };
+  uint8_t _gState;
+  int8_t _gesture;
+  uint8_t _interval;
+  bool _doubleClick;
+  uint16_t _stamp;
+  int _cmd[4];
+};
+
+/// @brief Class for all 16 pushbuttons of one expander handled as a unit. States are kept as bit masks
+/// (bit n = channel n). Each button is debounced like Button, with its own release timing, but only channels
+/// pressed or held cost per-button work, idle channels are skipped with a few word operations. Command names are taken from a PROGMEM table and registered with consecutive handles.
+class ButtonBank
+{
+public:
+  /// @brief Constructor
+  /// @param nExp Expander number (from DigitalIn initialization order)
+  ButtonBank(uint8_t nExp);
+
+  /// @brief Handle realtime. Read the expander word from DigitalIn and evaluate any transitions.
+  void handle()                 { _update(DigitalIn.getWord(_nExp)); if (_queued) _processCommand(true); };
+
+  /// @brief Handle realtime and process XPLDirect commands
+  void handleXP()               { handle(); processCommand(); };
+
+  /// @brief Evaluate and reset transitions of buttons pressed down
+  /// @return Mask of buttons pressed since last call
+  uint16_t pressed()            { uint16_t res = _pressed; _pressed = 0; return res; };
+
+  /// @brief Evaluate and reset transition of one button pressed down
+  /// @param channel Channel (0-15)
+  /// @return true: Button was pressed
+  bool pressed(uint8_t channel) { uint16_t bit = (1U << channel); return (_pressed & bit) ? (_pressed &= ~bit, true) : false; };
+
+  /// @brief Evaluate and reset transitions of buttons released
+  /// @return Mask of buttons released since last call
+  uint16_t released()           { uint16_t res = _released; _released = 0; return res; };
+
+  /// @brief Evaluate and reset transition of one button released
+  /// @param channel Channel (0-15)
+  /// @return true: Button was released
+  bool released(uint8_t channel) { uint16_t bit = (1U << channel); return (_released & bit) ? (_released &= ~bit, true) : false; };
+
+  /// @brief Evaluate status of all buttons
+  /// @return Mask of buttons currently held down
+  uint16_t engaged()            { return _engaged; };
+
+  /// @brief Register XPLDirect commands for the buttons of the bank, in ascending channel order
+  /// @param cmdNames Table of command names (in PROGMEM when XPL_USE_PROGMEM is set), one entry per bit set in mask
+  /// @param mask Channels with a command
+  /// @return true when successful, false when not all commands could be registered
+  bool setCommands(const char *const *cmdNames, uint16_t mask);
+
+  /// @brief Get XPLDirect command of one button
+  /// @param channel Channel (0-15)
+  /// @return Handle of the command, -1 when none
+  int getCommand(uint8_t channel);
+
+  /// @brief Process all transitions to XPLDirect (command start on press, end on release)
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+  /// @brief Queue transitions in InputEvents as soon as handle() detects them, so none is collapsed
+  /// and each event carries the time of its detection. processCommand() and queueCommand() are not needed then.
+  /// @param enable true: queue mode, false: keep transitions for processCommand() or queueCommand()
+  void setQueueMode(bool enable) { _queued = enable; };
+
+protected:
+  void _processCommand(bool queue);
+  void _update(uint16_t input);
+  uint8_t _nExp;
+  uint16_t _engaged;
+  uint16_t _pressed;
+  uint16_t _released;
+  Debounce_t _state[16];
+  bool _queued;
+  uint16_t _cmdMask;
+  int _cmdBase;
+};
+
+/// @brief Class for a simple pushbutton reading its input from a compile-time input source instead of DigitalIn,
+/// so the input read compiles to a single bit test.
+/// @tparam Input Class with static bool read() returning true when pressed, e.g. InputBank<...>::Input<0, 3>
+template <class Input>
+class StaticButton : public Button
+{
+public:
+  /// @brief Constructor
+  StaticButton() : Button(NOT_USED, NOT_USED) {};
+
+  /// @brief Handle realtime. Read input and evaluate any transitions.
+  void handle()                 { handle(true); };
+
+  /// @brief Handle realtime. Read input and evaluate any transitions.
+  /// @param input Additional mask bit. AND connected with physical input.
+  void handle(bool input)       { _update(Input::read() && input); if (_queued) _processCommand(true); };
+
+  /// @brief Handle realtime and process XPLDirect commands
+  void handleXP()               { handle(); processCommand(); };
+
+  /// @brief Handle realtime and process XPLDirect commands
+  /// @param input Additional mask bit. AND tied with physical input.
+  void handleXP(bool input)     { handle(input); processCommand(); };
+};
+
+/// @brief Class for a simple pushbutton on a direct Arduino pin known at compile time.
+/// Port and mask are resolved by the compiler, a read is a single port access.
+/// @tparam PIN Arduino pin number
+template <uint8_t PIN>
+class DirectButton : public StaticButton<PinInput<PIN>>
+{
+public:
+  /// @brief Constructor, sets pin to input with pullup
+  DirectButton() { PinInput<PIN>::begin(); };
+};
+
 #endif
@@ -12,6 +12,50 @@
 #define MCP_MAX_NUMBER 0
 #endif
 
+/// @brief Maximum number of 16 bit input words (pairs of 74HC165) read from shift register chains
+#ifndef SHIFTIN_MAX_NUMBER
+#define SHIFTIN_MAX_NUMBER 0
+#endif
+
+/// @brief Maximum number of rows of a keyboard matrix, every row is mapped to one expander (0 = no matrix, max. 16)
+#ifndef MATRIX_MAX_ROWS
+#define MATRIX_MAX_ROWS 0
+#endif
+
+/// @brief Maximum number of columns of a keyboard matrix (max. 16, one channel per column)
+#ifndef MATRIX_MAX_COLS
+#define MATRIX_MAX_COLS 16
+#endif
+#if MATRIX_MAX_ROWS > 16 || MATRIX_MAX_COLS > 16
+#error "A keyboard matrix supports max. 16 rows and 16 columns"
+#endif
+
+/// @brief Enable background scanning of multiplexers and shift registers from the Timer2 compare interrupt
+/// (AVR only; Timer2 is then no longer available for tone())
+#ifndef DIGITALIN_SCAN_ISR
+#define DIGITALIN_SCAN_ISR 0
+#endif
+#if DIGITALIN_SCAN_ISR && !defined(ARDUINO_ARCH_AVR)
+#error "DIGITALIN_SCAN_ISR is only supported on AVR"
+#endif
+
+/// @brief Debounce period in calls of handle() (used when DEBOUNCE_TIME is 0)
+#ifndef DEBOUNCE_DELAY
+#define DEBOUNCE_DELAY 20
+#endif
+
+/// @brief Debounce period in ms (1-255), independent of the loop rate. 0 = count calls of handle() instead
+/// (DEBOUNCE_DELAY). Requires DigitalIn.handle() to be called once per loop, which samples the time base
+/// shared by all input devices.
+#ifndef DEBOUNCE_TIME
+#define DEBOUNCE_TIME 0
+#endif
+#if DEBOUNCE_TIME > 255
+#error "DEBOUNCE_TIME must not exceed 255 ms"
+#endif
+
+#define EXP_MAX_NUMBER (MUX_MAX_NUMBER + MCP_MAX_NUMBER + SHIFTIN_MAX_NUMBER + MATRIX_MAX_ROWS)
+
 // Include i2c lib only when needed
 #if MCP_MAX_NUMBER > 0
 #include <Adafruit_MCP23X17.h>
@@ -19,8 +63,10 @@
 
 #define NOT_USED 255
 #define MCP_PIN  254
+#define SHIFT_PIN 253
+#define MATRIX_PIN 252
 
-/// @brief Class to encapsulate digital inputs from 74HC4067 and MCP23017 input multiplexers,
+/// @brief Class to encapsulate digital inputs from 74HC4067, MCP23017 and 74HC165 input expanders and a keyboard matrix,
 /// used by all digital input devices. Scans all expander inputs into internal process data image.
 class DigitalIn_
 {
@@ -40,26 +86,133 @@ public:
   /// @return true when successful, false when all multiplexers have been used up (increase MUX_MAX_NUMBER)
   bool addMux(uint8_t pin);
 
+  /// @brief Set multiplexer channel on the shared selector pins, also used by AnalogIn for analog multiplexers
+  /// @param ch Channel number (0..15)
+  void setMuxChannel(uint8_t ch);
+
+  /// @brief Get the number of selector pin changes, so an analog conversion can detect that the channel was
+  /// switched by someone else while it was running
+  /// @return Change counter (wraps around)
+  uint8_t muxChanges() { return _muxChanges; }
+
 #if MCP_MAX_NUMBER > 0
-  /// @brief Add one MCP23017 I2C IO expander
-  /// @param address I2C address of the expander (valid: 0x20-0x28)
+  /// @brief Add one MCP23017 I2C IO expander. All 16 pins are configured as inverted inputs with pullups
+  /// in a single I2C transaction.
+  /// @param address I2C address of the expander (valid: 0x20-0x27)
+  /// @param intPin Arduino pin connected to the (mirrored) INTA/INTB output of the expander, or NOT_USED to poll
+  /// the expander on every handle(). Several expanders may share the same pin (outputs are open drain).
   /// @return true when successful, false when all expanders have been used up (increase MCP_MAX_NUMBER)
-  bool addMCP(uint8_t address);
+  /// or the expander does not respond
+  bool addMCP(uint8_t address, uint8_t intPin = NOT_USED);
+
+  /// @brief Set the I2C bus clock used for MCP23017 expanders (MCP23017 supports up to 1.7 MHz)
+  /// @param clock Bus clock in Hz, default is fast mode (400 kHz)
+  void setI2CClock(uint32_t clock = 400000) { Wire.setClock(clock); }
 
   bool isMCP(uint8_t index) { return (_pin[index] == MCP_PIN); }
+
+  /// @brief Configure an MCP23017 as 16 inverted inputs with pullups in a single I2C transaction
+  /// @param address I2C address of the expander
+  /// @param interrupt Enable interrupt on change (INTA/INTB mirrored, open drain)
+  /// @return true when the expander acknowledged the configuration
+  static bool setupMCP(uint8_t address, bool interrupt);
+
+  /// @brief Read all 16 inputs of an MCP23017 set up with setupMCP()
+  /// @param address I2C address of the expander
+  /// @param value Input state (bit set = GND), unchanged when the expander does not respond
+  /// @return true when both input registers have been read
+  static bool readMCP(uint8_t address, uint16_t &value);
 #else
   bool isMCP(uint8_t index) { return false; }
 #endif
+
+#if SHIFTIN_MAX_NUMBER > 0
+  /// @brief Add a chain of 74HC165 shift registers. Every pair of chips is mapped to one expander number
+  /// (chip nearest to the Arduino = channels 0-7 of the first expander, next chip = channels 8-15 etc.).
+  /// @param pinData Arduino pin connected to Q7 of the chip nearest to the Arduino
+  /// @param pinClock Arduino pin connected to CP of all chips
+  /// @param pinLoad Arduino pin connected to PL of all chips
+  /// @param chips Number of chained 74HC165
+  /// @return true when successful, false when all expanders have been used up (increase SHIFTIN_MAX_NUMBER)
+  bool addShiftIn(uint8_t pinData, uint8_t pinClock, uint8_t pinLoad, uint8_t chips = 2);
+#endif
+
+#if MATRIX_MAX_ROWS > 0
+  /// @brief Add a keyboard matrix. Every row is mapped to one expander (in order of the row pins), every column
+  /// to one channel, so key (row, column) is read as expander (first row expander + row), channel column.
+  /// Rows are driven low one at a time (inactive rows high impedance), columns are inputs with pullups.
+  /// @param rowPins Arduino pins of the rows
+  /// @param rows Number of rows (max. MATRIX_MAX_ROWS)
+  /// @param colPins Arduino pins of the columns
+  /// @param cols Number of columns (max. MATRIX_MAX_COLS)
+  /// @param settle Settle time in us after a row has been activated
+  /// @param rowsPerHandle Number of rows scanned per handle() to limit the time spent per loop, 0 = all rows.
+  /// The image is updated when all rows have been scanned.
+  /// @return true when successful, false when a matrix is already defined or too many rows/columns/expanders
+  bool addMatrix(const uint8_t *rowPins, uint8_t rows, const uint8_t *colPins, uint8_t cols, uint8_t settle = 5,
+                 uint8_t rowsPerHandle = 0);
+
+  /// @brief Get the number of complete matrix scans with ghosting detected. Without diodes, three pressed keys in
+  /// a rectangle let the fourth corner appear pressed; the rows involved then keep their previous state.
+  /// @return Number of scans with ghosting since start
+  uint16_t matrixGhosts() { return _matrixGhosts; }
+#endif
+
+  /// @brief Check whether an expander is a 74HC4067 multiplexer (inputs can be polled directly)
+  /// @param index Expander number
+  /// @return true for multiplexers
+  bool isMux(uint8_t index) { return (_pin[index] < MATRIX_PIN); }
   
   /// @brief Get the state of one input from either a direct input pin or an expander.
   /// @param nExp expander to read from. Use NOT_USED to access Arduino digital input pin
   /// @param nChannel expander channel (0-15), or Arduino pin number when nExp = NOT_USED
-  /// @param direct poll actual input instead of cache (effective on multiplexers only)
+  /// @param direct poll actual input instead of cache (effective on multiplexers only, ignored during background scan)
   /// @return Status of the input (negative logic: true = GND, false = +5V)
   bool getBit(uint8_t expander, uint8_t channel, bool direct = false);
   
-  /// @brief Read all expander inputs into data cache; direct pins are not included (always read directly)
+  /// @brief Get all 16 inputs of one expander from the data cache
+  /// @param expander Expander to read from
+  /// @return Input states (bit set = GND)
+  uint16_t getWord(uint8_t expander) { return _data[expander]; }
+
+  /// @brief Read all expander inputs into data cache; direct pins are not included (always read directly).
+  /// During background scan, takes a consistent snapshot of the latest scan instead.
   void handle();
+
+  /// @brief Sample the shared time base and update the loop statistics, called by handle().
+  /// Call it instead when inputs are read by other means only (e.g. InputBank).
+  void tick();
+
+  /// @brief Get the time base sampled by the last handle(), all devices debounce against the same timestamp
+  /// @return Time in ms (lower 16 bits of millis())
+  uint16_t now() { return _now; }
+
+  /// @brief Get the average interval between calls of handle(), measured over 256 ms
+  /// @return Interval in us, 0 until the first measurement is complete
+  uint16_t loopInterval() { return _loopInterval; }
+
+  /// @brief Get the effective debounce window for the current loop rate
+  /// @return Debounce window in us
+  uint32_t debounceWindow();
+
+#if DIGITALIN_SCAN_ISR
+  /// @brief Start background scanning of multiplexers and shift registers from the Timer2 compare interrupt.
+  /// MCP23017 expanders and the keyboard matrix are still read by handle().
+  /// @param rate Scan rate in Hz (62 to 65535, limited by scan duration)
+  /// @return true when Timer2 could be set up for the requested rate
+  bool startScan(uint16_t rate);
+
+  /// @brief Stop background scanning, handle() reads expanders directly again
+  void stopScan();
+
+  /// @brief Get and reset the jitter of the background scan interval
+  /// @return Difference between longest and shortest scan interval since last call in us
+  uint16_t scanJitter();
+
+  /// @brief Scan into back buffer and swap buffers, called from timer interrupt
+  void scanISR();
+#endif
+
 private:
   uint8_t _s0, _s1, _s2, _s3;
 #ifdef ARDUINO_ARCH_AVR
@@ -67,19 +220,164 @@ private:
   uint8_t _s0mask, _s1mask, _s2mask, _s3mask;
 #endif
   uint8_t _nExpanders;
-  uint8_t _pin[MUX_MAX_NUMBER + MCP_MAX_NUMBER];
-  int16_t _data[MUX_MAX_NUMBER + MCP_MAX_NUMBER];
+  uint8_t _numMux;
+  volatile uint8_t _muxChanges;
+  uint8_t _pin[EXP_MAX_NUMBER];
+  int16_t _data[EXP_MAX_NUMBER];
+  uint16_t _now;
+  uint16_t _statStart;
+  uint16_t _loopCount;
+  uint16_t _loopInterval;
 #if MCP_MAX_NUMBER > 0
   uint8_t _numMCP;
   Adafruit_MCP23X17 _mcp[MCP_MAX_NUMBER];
+  uint8_t _mcpInt[MCP_MAX_NUMBER];
 #endif
-  /// @brief Set multiplexer channel.
-  /// @param ch Channel number (0..15)
-  void setMuxChannel(uint8_t ch);
-  
+#if SHIFTIN_MAX_NUMBER > 0
+  struct ShiftChain_t
+  {
+    uint8_t pinData, pinClock, pinLoad;
+#ifdef ARDUINO_ARCH_AVR
+    uint8_t dataPort, clockPort, loadPort;
+    uint8_t dataMask, clockMask, loadMask;
+#endif
+    uint8_t first;
+    uint8_t chips;
+  } _shift[SHIFTIN_MAX_NUMBER];
+  uint8_t _numShift;
+  uint8_t _numShiftWords;
+
+  /// @brief Clock in a complete 74HC165 chain into the data image
+  /// @param chain Chain descriptor
+  /// @param data Data image to fill
+  void readShift(ShiftChain_t &chain, int16_t *data);
+#endif
+#if MATRIX_MAX_ROWS > 0
+  uint8_t _rowPin[MATRIX_MAX_ROWS];
+  uint8_t _colPin[MATRIX_MAX_COLS];
+#ifdef ARDUINO_ARCH_AVR
+  uint8_t _rowPort[MATRIX_MAX_ROWS], _rowMask[MATRIX_MAX_ROWS];
+  uint8_t _colPort[MATRIX_MAX_COLS], _colMask[MATRIX_MAX_COLS];
+#endif
+  uint8_t _numRows;
+  uint8_t _numCols;
+  uint8_t _matrixFirst;
+  uint8_t _matrixRow;
+  uint8_t _matrixSettle;
+  uint8_t _rowsPerHandle;
+  uint16_t _matrixGhosts;
+  int16_t _matrixScan[MATRIX_MAX_ROWS];
+
+  /// @brief Scan the next rows of the keyboard matrix, publish the image after the last row
+  void scanMatrix();
+
+  /// @brief Read all columns of one matrix row
+  /// @param row Row number
+  /// @return Column states (bit set = key pressed)
+  uint16_t readRow(uint8_t row);
+#endif
+#if DIGITALIN_SCAN_ISR
+  int16_t _buffer[2][EXP_MAX_NUMBER];
+  volatile uint8_t _seq;
+  volatile bool _scanning;
+  uint16_t _lastScan;
+  volatile uint16_t _minInterval;
+  volatile uint16_t _maxInterval;
+#endif
+  /// @brief Read multiplexers and shift registers (all expanders except MCP23017)
+  /// @param data Data image to fill
+  void scan(int16_t *data);
+
 };
 
 /// @brief Instance of the class for system wide use
 extern DigitalIn_ DigitalIn;
 
+/// @brief Get the index of the lowest set bit of an input word in constant time
+/// @param bits Input word, must not be 0
+/// @return Bit index (0-15)
+uint8_t lowestBit(uint16_t bits);
+
+#if DEBOUNCE_TIME > 0
+/// @brief Debounce state of one input: high byte active flag, low byte timestamp (ms) of the last activity
+typedef uint16_t Debounce_t;
+#else
+/// @brief Debounce state of one input: remaining calls of handle()
+typedef uint8_t Debounce_t;
+#endif
+
+/// @brief Debounce a pushbutton input. A press is reported at once, the release after the input
+/// has been open for the debounce period.
+/// @param state Debounce state of the input, 0 = released
+/// @param input Current input (true = pressed)
+/// @return 0: no change, 1: pressed, 2: released
+inline uint8_t debouncePush(Debounce_t &state, bool input)
+{
+#if DEBOUNCE_TIME > 0
+  uint8_t now = (uint8_t)DigitalIn.now();
+  if (input)
+  {
+    bool engaged = (state != 0);
+    state = 0x0100 | now;
+    return engaged ? 0 : 1;
+  }
+  if (state != 0 && (uint8_t)(now - (uint8_t)state) >= DEBOUNCE_TIME)
+  {
+    state = 0;
+    return 2;
+  }
+  return 0;
+#else
+  if (input)
+  {
+    if (state == 0)
+    {
+      state = DEBOUNCE_DELAY;
+      return 1;
+    }
+  }
+  else if (state > 0)
+  {
+    if (--state == 0)
+    {
+      return 2;
+    }
+  }
+  return 0;
+#endif
+}
+
+/// @brief Start the debounce period after a change of a switch input
+/// @param state Debounce state of the input
+inline void debounceStart(Debounce_t &state)
+{
+#if DEBOUNCE_TIME > 0
+  state = 0x0100 | (uint8_t)DigitalIn.now();
+#else
+  state = DEBOUNCE_DELAY;
+#endif
+}
+
+/// @brief Check the debounce period of a switch input, call once per handle()
+/// @param state Debounce state of the input
+/// @return true while the input must not be evaluated
+inline bool debouncing(Debounce_t &state)
+{
+#if DEBOUNCE_TIME > 0
+  if (state != 0 && (uint8_t)((uint8_t)DigitalIn.now() - (uint8_t)state) < DEBOUNCE_TIME)
+  {
+    return true;
+  }
+  state = 0;
+  return false;
+#else
+  if (state > 0)
+  {
+    state--;
+    return true;
+  }
+  return false;
+#endif
+}
+
 #endif
@@ -2,6 +2,11 @@
 #define Encoder_h
 #include <Arduino.h>
 #include <DigitalIn.h>
+#include <InputEvents.h>
+#include <directIO.h>
+
+/// @brief Maximum number of interrupt driven encoders
+#define ENCODER_INT_MAX 4
 
 enum EncCmd_t
 {
@@ -65,7 +70,7 @@ public:
 
   /// @brief Evaluate status of Encoder push function
   /// @return true: Button is currently held down  
-  bool engaged()    { return _state > 0; };
+  bool engaged()    { return _debounce > 0; };
 
   /// @brief Set XPLDirect commands for Encoder events
   /// @param cmdUp Command handle for positive turn as returned by XP.registerCommand()
@@ -94,25 +99,243 @@ public:
   /// @return Handle of the command, -1 = no command
   int getCommand(EncCmd_t cmd);
 
-  /// @brief Check for Encoder events and process XPLDirect commands as appropriate
-  void processCommand();
-private:
+  /// @brief Enable velocity based acceleration. Notches closer together than slowMs are multiplied,
+  /// rising linearly up to maxFactor for notches fastMs apart or less.
+  /// @param slowMs Time between notches in ms below which acceleration starts
+  /// @param fastMs Time between notches in ms at which maxFactor is reached
+  /// @param maxFactor Maximum number of steps per notch
+  void setAcceleration(uint8_t slowMs, uint8_t fastMs, uint8_t maxFactor);
+
+  /// @brief Change a value directly instead of sending commands, e.g. a float registered with
+  /// XP.registerDataRef() as XPL_WRITE or XPL_READWRITE
+  /// @param value Value to change
+  /// @param step Change per (accelerated) notch
+  /// @param minValue Lower limit of value
+  /// @param maxValue Upper limit of value
+  /// @param wrap true: wrap around at the limits (e.g. heading 0..360), false: clamp to limits
+  void setDataRef(float *value, float step, float minValue, float maxValue, bool wrap = false);
+
+  /// @brief Check for Encoder events and process XPLDirect commands as appropriate. All pending notches
+  /// are sent as one command with repeat count (or one value change).
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+  /// @brief Queue transitions in InputEvents as soon as handle() detects them, so none is collapsed
+  /// and each event carries the time of its detection. processCommand() and queueCommand() are not needed then.
+  /// @param enable true: queue mode, false: keep transitions for processCommand() or queueCommand()
+  void setQueueMode(bool enable) { _queued = enable; };
+
+protected:
+  void _processCommand(bool queue);
+  struct EncAccel_t
+  {
+    uint32_t lastNotch;
+    uint8_t slowMs;
+    uint8_t fastMs;
+    uint8_t maxFactor;
+  };
+  struct EncValue_t
+  {
+    float *value;
+    float step;
+    float min;
+    float max;
+    bool wrap;
+  };
+  int16_t _takeNotches();
+  void _processNotches(int16_t notches, bool queue);
   enum
   {
     transNone,
     transPressed,
     transReleased
   };
+  void _update(bool inputA, bool inputB);
+  void _updatePush(bool input);
+  void _processPush(bool queue);
   uint8_t _nExp;
   uint8_t _pin1, _pin2, _pin3;
   int8_t _count;
   uint8_t _pulses;
   uint8_t _state;
-  uint8_t _debounce;
+  Debounce_t _debounce;
   uint8_t _transition;
+  bool _queued;
   int _cmdUp;
   int _cmdDown;
   int _cmdPush;
+  EncAccel_t *_accel;
+  EncValue_t *_value;
+};
+
+/// @brief Class for rotary encoders on direct pins decoded in pin interrupts, so no counts are lost
+/// regardless of loop timing. Both track pins must be interrupt capable (see digitalPinToInterrupt(),
+/// e.g. 2, 3, 18, 19, 20, 21 on a Mega), otherwise the tracks are polled in handle() as a fallback.
+class IntEncoder : public Encoder
+{
+public:
+  /// @brief Constructor. Sets connected pins, number of counts per notch and attaches the interrupts.
+  /// @param pin1 pin for Encoder A track
+  /// @param pin2 pin for Encoder B track
+  /// @param pin3 pin for Encoder push function (NOT_USED if not connected)
+  /// @param pulses Number of counts per mechanical notch
+  IntEncoder(uint8_t pin1, uint8_t pin2, uint8_t pin3, EncPulse_t pulses);
+
+  /// @brief Handle realtime. Evaluate push function (tracks are decoded in the interrupt).
+  void handle();
+
+  /// @brief Handle realtime and process XPLDirect commands.
+  void handleXP()   { handle(); processCommand(); };
+
+  /// @brief Read current Encoder count.
+  /// @return Remaining Encoder count.
+  int16_t pos();
+
+  /// @brief Evaluate Encoder up one notch (positive turn) and consume event
+  /// @return true: up event available and transition reset.
+  bool up();
+
+  /// @brief Evaluate Encoder down one notch (negative turn) and consume event
+  /// @return true: down event available and transition reset.
+  bool down();
+
+  /// @brief Check whether the tracks are decoded in interrupts
+  /// @return true: interrupts attached, false: polled in handle()
+  bool isAttached() { return _attached; };
+
+  /// @brief Check for Encoder events and process XPLDirect commands, all pending notches in one command
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+  /// @brief Decode tracks into the accumulator, called from pin interrupt
+  void _decode();
+
+  static IntEncoder *_instance[ENCODER_INT_MAX];
+
+private:
+  void _processCommand(bool queue);
+  int16_t _takeNotches();
+  volatile int16_t _acc;
+  bool _attached;
+#ifdef ARDUINO_ARCH_AVR
+  volatile uint8_t *_inA;
+  volatile uint8_t *_inB;
+  uint8_t _maskA;
+  uint8_t _maskB;
+#endif
+  static uint8_t _numInstances;
+};
+
+/// @brief Class for up to 8 rotary encoders on one expander, decoded together from the DigitalIn process image.
+/// Encoder n uses channel 2n for the A track and channel 2n+1 for the B track.
+class EncoderBank
+{
+public:
+  /// @brief Constructor. Sets expander and number of counts per notch.
+  /// @param nExp expander number (from DigitalIn initialization order)
+  /// @param pulses Number of counts per mechanical notch
+  EncoderBank(uint8_t nExp, EncPulse_t pulses);
+
+  /// @brief Handle realtime. Decode all encoders from the current DigitalIn process image.
+  void handle();
+
+  /// @brief Handle realtime and process XPLDirect commands.
+  void handleXP()   { handle(); processCommand(); };
+
+  /// @brief Read current Encoder count.
+  /// @param enc Encoder number (0-7)
+  /// @return Remaining Encoder count.
+  int16_t pos(uint8_t enc)  { return _count[enc & 0x07]; };
+
+  /// @brief Evaluate Encoder up one notch (positive turn) and consume event
+  /// @param enc Encoder number (0-7)
+  /// @return true: up event available and transition reset.
+  bool up(uint8_t enc);
+
+  /// @brief Evaluate Encoder down one notch (negative turn) and consume event
+  /// @param enc Encoder number (0-7)
+  /// @return true: down event available and transition reset.
+  bool down(uint8_t enc);
+
+  /// @brief Set XPLDirect commands for Encoder events
+  /// @param enc Encoder number (0-7)
+  /// @param cmdUp Command handle for positive turn as returned by XP.registerCommand()
+  /// @param cmdDown Command handle for negative turn as returned by XP.registerCommand()
+  void setCommand(uint8_t enc, int cmdUp, int cmdDown);
+
+  /// @brief Set XPLDirect commands for Encoder events
+  /// @param enc Encoder number (0-7)
+  /// @param cmdNameUp Command for positive turn
+  /// @param cmdNameDown Command for negative turn
+  void setCommand(uint8_t enc, XPString_t *cmdNameUp, XPString_t *cmdNameDown);
+
+  /// @brief Check for Encoder events and process XPLDirect commands, one command per encoder and direction
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+  /// @brief Queue transitions in InputEvents as soon as handle() detects them, so none is collapsed
+  /// and each event carries the time of its detection. processCommand() and queueCommand() are not needed then.
+  /// @param enable true: queue mode, false: keep transitions for processCommand() or queueCommand()
+  void setQueueMode(bool enable) { _queued = enable; };
+
+private:
+  void _processCommand(bool queue);
+  uint8_t _nExp;
+  uint8_t _pulses;
+  uint16_t _last;
+  bool _queued;
+  int8_t _count[8];
+  int _cmdUp[8];
+  int _cmdDown[8];
+};
+
+/// @brief Input source for StaticEncoder without push function
+struct NoInput
+{
+  static bool read() { return false; }
+};
+
+/// @brief Class for rotary encoders reading their inputs from compile-time input sources instead of DigitalIn,
+/// so each input read compiles to a single bit test.
+/// @tparam InputA Class with static bool read() for Encoder A track, e.g. InputBank<...>::Input<0, 3>
+/// @tparam InputB Class with static bool read() for Encoder B track
+/// @tparam InputPush Class with static bool read() for Encoder push function (NoInput if not connected)
+template <class InputA, class InputB, class InputPush = NoInput>
+class StaticEncoder : public Encoder
+{
+public:
+  /// @brief Constructor. Sets number of counts per notch.
+  /// @param pulses Number of counts per mechanical notch
+  StaticEncoder(EncPulse_t pulses) : Encoder(NOT_USED, NOT_USED, NOT_USED, NOT_USED, pulses) {}
+
+  /// @brief Handle realtime. Read input and evaluate any transitions.
+  void handle()     { _update(InputA::read(), InputB::read()); _updatePush(InputPush::read()); if (_queued) _processCommand(true); };
+
+  /// @brief Handle realtime and process XPLDirect commands.
+  void handleXP()   { handle(); processCommand(); };
+};
+
+/// @brief Class for rotary encoders on direct Arduino pins known at compile time.
+/// Ports and masks are resolved by the compiler, each read is a single port access.
+/// @tparam PIN1 pin for Encoder A track
+/// @tparam PIN2 pin for Encoder B track
+template <uint8_t PIN1, uint8_t PIN2>
+class DirectEncoder : public StaticEncoder<PinInput<PIN1>, PinInput<PIN2>>
+{
+public:
+  /// @brief Constructor. Sets pins to input with pullup and number of counts per notch.
+  /// @param pulses Number of counts per mechanical notch
+  DirectEncoder(EncPulse_t pulses) : StaticEncoder<PinInput<PIN1>, PinInput<PIN2>>(pulses)
+  {
+    PinInput<PIN1>::begin();
+    PinInput<PIN2>::begin();
+  }
 };
 
 #endif
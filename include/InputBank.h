@@ -0,0 +1,224 @@
+#ifndef InputBank_h
+#define InputBank_h
+#include <Arduino.h>
+#include <DigitalIn.h>
+#include <directIO.h>
+
+// Compile-time configured input banks. Backends and pins are template parameters, so reading one input of a
+// device compiles to a bit test on a word at a fixed address. DigitalIn remains the generic runtime solution.
+//
+// Example:
+//   typedef InputBank<MuxInputs<22, 23, 24, 25, 38, 39>, DirectInputs<2, 3, 4>> Panel;
+//   StaticButton<Panel::Input<0, 5>> btnStart;      // MUX0 channel 5
+//   StaticSwitch<Panel::Input<2, 1>> swStrobe;      // direct pin 3
+//   setup(): Panel::begin();  loop(): Panel::handle(); btnStart.handleXP(); ...
+
+/// @brief Input backend for direct Arduino pins, mapped to the channels of one expander in order of the
+/// template arguments (max. 16)
+/// @tparam PINS Arduino pin numbers
+template <uint8_t... PINS>
+struct DirectInputs;
+
+template <>
+struct DirectInputs<>
+{
+  static const uint8_t words = 1;
+  static void begin() {}
+  static uint16_t read() { return 0; }
+  static void scan(uint16_t *data) { data[0] = 0; }
+};
+
+template <uint8_t PIN, uint8_t... MORE>
+struct DirectInputs<PIN, MORE...>
+{
+  static_assert(sizeof...(MORE) < 16, "DirectInputs supports max. 16 pins");
+  static const uint8_t words = 1;
+  static void begin() { FastPin<PIN>::mode(INPUT_PULLUP); DirectInputs<MORE...>::begin(); }
+  static uint16_t read() { return (DirectInputs<MORE...>::read() << 1) | (FastPin<PIN>::read() ? 0 : 1); }
+  static void scan(uint16_t *data) { data[0] = read(); }
+};
+
+/// @brief Data pins of 74HC4067 multiplexers, helper for MuxInputs
+template <uint8_t... PINS>
+struct MuxData;
+
+template <>
+struct MuxData<>
+{
+  static void begin() {}
+  static void read(uint16_t *data, uint16_t mask) {}
+};
+
+template <uint8_t PIN, uint8_t... MORE>
+struct MuxData<PIN, MORE...>
+{
+  static void begin() { pinMode(PIN, INPUT); MuxData<MORE...>::begin(); }
+  static void read(uint16_t *data, uint16_t mask)
+  {
+    if (!FastPin<PIN>::read()) data[0] |= mask;
+    MuxData<MORE...>::read(data + 1, mask);
+  }
+};
+
+/// @brief Input backend for 74HC4067 multiplexers sharing the same selector pins, one expander per multiplexer
+/// @tparam S0 Selector pin s0
+/// @tparam S1 Selector pin s1
+/// @tparam S2 Selector pin s2
+/// @tparam S3 Selector pin s3
+/// @tparam PINS Data pins of the multiplexers
+template <uint8_t S0, uint8_t S1, uint8_t S2, uint8_t S3, uint8_t... PINS>
+struct MuxInputs
+{
+  static_assert(sizeof...(PINS) > 0, "MuxInputs needs at least one data pin");
+  static const uint8_t words = sizeof...(PINS);
+  static void begin()
+  {
+    FastPin<S0>::mode(OUTPUT);
+    FastPin<S1>::mode(OUTPUT);
+    FastPin<S2>::mode(OUTPUT);
+    FastPin<S3>::mode(OUTPUT);
+    MuxData<PINS...>::begin();
+  }
+  static void scan(uint16_t *data)
+  {
+    for (uint8_t i = 0; i < words; i++) data[i] = 0;
+    for (uint8_t ch = 0; ch < 16; ch++)
+    {
+      FastPin<S3>::write(ch & 0x08);
+      FastPin<S2>::write(ch & 0x04);
+      FastPin<S1>::write(ch & 0x02);
+      FastPin<S0>::write(ch & 0x01);
+      delayMicroseconds(1);     // Allow signals to settle
+      MuxData<PINS...>::read(data, 1 << ch);
+    }
+  }
+};
+
+/// @brief Input backend for a chain of 74HC165 shift registers, one expander per pair of chips
+/// (chip nearest to the Arduino = channels 0-7 of the first expander)
+/// @tparam DATA Arduino pin connected to Q7 of the chip nearest to the Arduino
+/// @tparam CLOCK Arduino pin connected to CP of all chips
+/// @tparam LOAD Arduino pin connected to PL of all chips
+/// @tparam CHIPS Number of chained 74HC165
+template <uint8_t DATA, uint8_t CLOCK, uint8_t LOAD, uint8_t CHIPS = 2>
+struct ShiftInputs
+{
+  static_assert(CHIPS > 0, "ShiftInputs needs at least one chip");
+  static const uint8_t words = (CHIPS + 1) / 2;
+  static void begin()
+  {
+    pinMode(DATA, INPUT);
+    FastPin<CLOCK>::mode(OUTPUT);
+    FastPin<LOAD>::mode(OUTPUT);
+    FastPin<CLOCK>::write(LOW);
+    FastPin<LOAD>::write(HIGH);
+  }
+  static void scan(uint16_t *data)
+  {
+    FastPin<LOAD>::write(LOW);
+    FastPin<LOAD>::write(HIGH);
+    uint8_t *bytes = (uint8_t *)data;     // little endian: even chip = channels 0-7
+    for (uint8_t chip = 0; chip < CHIPS; chip++)
+    {
+      uint8_t val = 0;
+      for (uint8_t bit = 0; bit < 8; bit++)
+      {
+        val <<= 1;
+        if (!FastPin<DATA>::read()) val |= 1;
+        FastPin<CLOCK>::write(HIGH);
+        FastPin<CLOCK>::write(LOW);
+      }
+      bytes[chip] = val;
+    }
+  }
+};
+
+#if MCP_MAX_NUMBER > 0
+/// @brief Input backend for one MCP23017 I2C IO expander (polled)
+/// @tparam ADDRESS I2C address of the expander (0x20-0x27)
+template <uint8_t ADDRESS>
+struct MCPInputs
+{
+  static const uint8_t words = 1;
+  static void begin() { Wire.begin(); DigitalIn_::setupMCP(ADDRESS, false); }
+  static void scan(uint16_t *data) { DigitalIn_::readMCP(ADDRESS, data[0]); }     // keeps image on failure
+};
+#endif
+
+/// @brief Helper to iterate over the backends of an InputBank
+template <class... BACKENDS>
+struct BankBackends;
+
+template <>
+struct BankBackends<>
+{
+  static const uint8_t words = 0;
+  static void begin() {}
+  static void scan(uint16_t *data) {}
+};
+
+template <class BACKEND, class... MORE>
+struct BankBackends<BACKEND, MORE...>
+{
+  static const uint8_t words = BACKEND::words + BankBackends<MORE...>::words;
+  static void begin() { BACKEND::begin(); BankBackends<MORE...>::begin(); }
+  static void scan(uint16_t *data) { BACKEND::scan(data); BankBackends<MORE...>::scan(data + BACKEND::words); }
+};
+
+/// @brief Compile-time configured input bank. Each backend occupies consecutive expander numbers in order
+/// of the template arguments; the state of all inputs is held in a static process image.
+/// @tparam BACKENDS Input backends (DirectInputs, MuxInputs, ShiftInputs, MCPInputs)
+template <class... BACKENDS>
+class InputBank
+{
+public:
+  /// @brief Number of 16 bit expander words in the bank
+  static const uint8_t words = BankBackends<BACKENDS...>::words;
+
+  /// @brief Setup all pins and expanders, call once in setup()
+  static void begin()     { BankBackends<BACKENDS...>::begin(); }
+
+  /// @brief Read all inputs into the process image, call once per loop.
+  /// With time based debouncing, also samples the shared time base unless DigitalIn.handle() is used.
+  static void handle()
+  {
+    BankBackends<BACKENDS...>::scan(_data);
+#if DEBOUNCE_TIME > 0
+    DigitalIn.tick();
+#endif
+  }
+
+  /// @brief Get the state of one input from the process image
+  /// @tparam EXP Expander number in the bank
+  /// @tparam CH Channel on the expander (0-15)
+  /// @return Status of the input (true = GND)
+  template <uint8_t EXP, uint8_t CH>
+  static bool get()
+  {
+    static_assert(EXP < words, "Expander number out of range");
+    static_assert(CH < 16, "Channel out of range");
+    return (_data[EXP] & (1 << CH)) != 0;
+  }
+
+  /// @brief Get all 16 inputs of one expander from the process image
+  /// @param exp Expander number in the bank
+  /// @return Input states (bit set = GND)
+  static uint16_t getWord(uint8_t exp) { return _data[exp]; }
+
+  /// @brief Input source for StaticButton, StaticSwitch and StaticEncoder
+  /// @tparam EXP Expander number in the bank
+  /// @tparam CH Channel on the expander (0-15)
+  template <uint8_t EXP, uint8_t CH>
+  struct Input
+  {
+    static bool read() { return get<EXP, CH>(); }
+  };
+
+private:
+  static uint16_t _data[words];
+};
+
+template <class... BACKENDS>
+uint16_t InputBank<BACKENDS...>::_data[InputBank<BACKENDS...>::words];
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef InputEvents_h
+#define InputEvents_h
+#include <Arduino.h>
+
+/// @brief Capacity of the input event queue (power of 2, max. 128)
+#ifndef INPUT_EVENTS_SIZE
+#define INPUT_EVENTS_SIZE 16
+#endif
+#if INPUT_EVENTS_SIZE > 128 || (INPUT_EVENTS_SIZE & (INPUT_EVENTS_SIZE - 1)) != 0
+#error "INPUT_EVENTS_SIZE must be a power of 2 and not exceed 128"
+#endif
+
+/// @brief Type of an input event, corresponds to the XPLDirect command functions
+enum InputEventType_t
+{
+  eventTrigger,       ///< XP.commandTrigger() with repeat count
+  eventStart,         ///< XP.commandStart()
+  eventEnd            ///< XP.commandEnd()
+};
+
+/// @brief One timestamped input event
+struct InputEvent_t
+{
+  uint16_t time;      ///< lower 16 bits of millis() when queued (when detected in queue mode)
+  int16_t cmd;        ///< command handle as returned by XP.registerCommand()
+  uint16_t count;     ///< repeat count for eventTrigger
+  uint8_t type;       ///< InputEventType_t
+};
+
+/// @brief Lock-free single producer / single consumer queue of input events between scanning and the
+/// XPLDirect protocol. Devices in queue mode (setQueueMode()) push every transition from handle() as it is
+/// detected, so no transition is lost when the protocol side is serviced less often than the inputs.
+/// queueCommand() queues the transitions kept since the last call instead, stamped when queued.
+/// The producer may be an interrupt, but all events must be queued from the same context.
+class InputEvents_
+{
+public:
+  /// @brief Class constructor
+  InputEvents_();
+
+  /// @brief Queue an event (producer side)
+  /// @param type Event type
+  /// @param cmd Command handle, events for handles < 0 are ignored
+  /// @param count Repeat count for eventTrigger
+  /// @return true when queued, false when the queue was full (event counted as lost)
+  bool push(uint8_t type, int cmd, uint16_t count = 1);
+
+  /// @brief Take the oldest event from the queue (consumer side)
+  /// @param event Event taken
+  /// @return true when an event was available
+  bool pop(InputEvent_t &event);
+
+  /// @brief Get number of queued events
+  /// @return Events waiting for processXP()
+  uint8_t pending() { return (uint8_t)(_head - _tail); }
+
+  /// @brief Send all queued events to XPlane, call once per loop after XP.xloop()
+  void processXP();
+
+  /// @brief Send one event to XPlane at once
+  /// @param type Event type
+  /// @param cmd Command handle
+  /// @param count Repeat count for eventTrigger
+  static void send(uint8_t type, int cmd, uint16_t count = 1);
+
+  /// @brief Get number of events lost because the queue was full
+  /// @return Lost events since start
+  uint16_t lost();
+
+  /// @brief Get and reset the longest time an event spent in the queue
+  /// @return Input to command latency in ms since last call
+  uint16_t maxLatency();
+
+private:
+  InputEvent_t _events[INPUT_EVENTS_SIZE];
+  volatile uint8_t _head;
+  volatile uint8_t _tail;
+  volatile uint16_t _lost;
+  uint16_t _maxLatency;
+};
+
+/// @brief Instance of the class for system wide use
+extern InputEvents_ InputEvents;
+
+/// @brief Send a command event at once or queue it, used by the devices for processCommand() and queueCommand()
+/// @param queue true: queue the event, false: send it to XPlane
+/// @param type Event type
+/// @param cmd Command handle, ignored when < 0
+/// @param count Repeat count for eventTrigger
+inline void commandEvent(bool queue, uint8_t type, int cmd, uint16_t count = 1)
+{
+  if (queue)
+  {
+    InputEvents.push(type, cmd, count);
+  }
+  else
+  {
+    InputEvents_::send(type, cmd, count);
+  }
+}
+
+#endif
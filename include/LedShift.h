@@ -1,6 +1,7 @@
 #ifndef LedShift_h
 #define LedShift_h
 #include <Arduino.h>
+#include <ShiftOut.h>
 
 /// @brief LED display modes to show
 enum led_t
@@ -17,22 +18,15 @@ enum led_t
   ledOn = 0x08
 };
 
-/// @brief Class to encapsulate a DM13A LED driver IC
-class LedShift
+/// @brief LEDs on DM13A LED driver ICs, use LedShift or LedShiftN
+class LedShiftBase : public ShiftChains
 {
 public:
-  /// @brief Constructor, setup DM13A LED driver and set pins
-  /// @param pin_DAI DAI pin of DM13A
-  /// @param pin_DCK DCL pin of DM13A
-  /// @param pin_LAT LAT pin of DM13A
-  /// @param pins Number of LED pins for cascaded LED drivers (max 64)
-  LedShift(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint8_t pins = 16);
-
   /// @brief Set one LED to a display mode
-  /// @param pin DM13A pin of the LED (0-64)
+  /// @param pin DM13A pin of the LED (0 to pins() - 1)
   /// @param mode LED display mode (ledOff, ledFast, ledMedium, ledSlow, ledOn)
-  void setPin(uint8_t pin, led_t mode);
-  void set(uint8_t pin, led_t mode) { setPin(pin, mode); }; // obsolete
+  void setPin(uint16_t pin, led_t mode);
+  void set(uint16_t pin, led_t mode) { setPin(pin, mode); }; // obsolete
 
   /// @brief Set display mode for all LEDs
   /// @param mode LED display mode (ledOff, ledFast, ledMedium, ledSlow, ledOn)
@@ -42,16 +36,48 @@ public:
   /// @brief Real time handling, call cyclic in loop()
   void handle();
 
+protected:
+  LedShiftBase(uint8_t *planes, uint16_t capacity, ShiftChain_t *chains, uint8_t maxChains,
+               uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins);
+
 private:
-  void _send();
-  uint8_t _pin_DAI;
-  uint8_t _pin_DCK;
-  uint8_t _pin_LAT;
-  uint8_t _pins;
-  led_t _mode[64];
-  uint8_t _count;
   unsigned long _timer;
-  bool _update;
+};
+
+/// @brief DM13A LED drivers with capacity set at compile time
+/// @tparam PINS Maximum number of LEDs of all chains
+/// @tparam CHAINS Maximum number of chains clocked in parallel (max. 8)
+template <uint16_t PINS, uint8_t CHAINS = 1>
+class LedShiftN : public LedShiftBase
+{
+  static_assert(CHAINS > 0 && CHAINS <= 8, "LedShiftN supports 1 to 8 chains");
+
+public:
+  /// @brief Constructor, setup DM13A LED driver and set pins
+  /// @param pin_DAI DAI pin of the first chain, SPI_PIN for hardware SPI (needs SHIFTOUT_SPI)
+  /// @param pin_DCK DCL pin of DM13A, ignored for hardware SPI
+  /// @param pin_LAT LAT pin of DM13A
+  /// @param pins Number of LED pins of the first chain (max PINS)
+  LedShiftN(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins = 16)
+      : LedShiftBase(_planes, PINS, _chains, CHAINS, pin_DAI, pin_DCK, pin_LAT, pins) {}
+
+private:
+  // display modes as bit planes: on, fast, medium, slow
+  uint8_t _planes[4 * ((PINS + 7) / 8)];
+  ShiftChain_t _chains[CHAINS];
+};
+
+/// @brief Class to encapsulate a DM13A LED driver IC
+class LedShift : public LedShiftN<64>
+{
+public:
+  /// @brief Constructor, setup DM13A LED driver and set pins
+  /// @param pin_DAI DAI pin of DM13A, SPI_PIN for hardware SPI (needs SHIFTOUT_SPI)
+  /// @param pin_DCK DCL pin of DM13A, ignored for hardware SPI
+  /// @param pin_LAT LAT pin of DM13A
+  /// @param pins Number of LED pins for cascaded LED drivers (max 64, use LedShiftN for more)
+  LedShift(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins = 16)
+      : LedShiftN<64>(pin_DAI, pin_DCK, pin_LAT, pins) {}
 };
 
 #endif
@@ -2,21 +2,131 @@
 #define ShiftOut_h
 #include <Arduino.h>
 
-/// @brief Class to encapsulate a DM13A LED driver IC
-class ShiftOut
+/// @brief Enable hardware SPI for shift register chains: ShiftOut and LedShift constructed with pin_DAI = SPI_PIN
+/// use MOSI and SCK of the SPI interface, bytes are sent from the SPI interrupt without blocking (AVR only)
+#ifndef SHIFTOUT_SPI
+#define SHIFTOUT_SPI 0
+#endif
+#if SHIFTOUT_SPI && !defined(ARDUINO_ARCH_AVR)
+#error "SHIFTOUT_SPI is only supported on AVR"
+#endif
+
+/// @brief SPI clock for shift register chains in Hz
+#ifndef SHIFTOUT_SPI_CLOCK
+#define SHIFTOUT_SPI_CLOCK 4000000
+#endif
+
+/// @brief Maximum length of a chain on hardware SPI in bytes (8 outputs each), the outputs are copied into a
+/// frame buffer of this size when a transfer starts
+#ifndef SHIFTOUT_SPI_MAX_BYTES
+#define SHIFTOUT_SPI_MAX_BYTES 32
+#endif
+#if SHIFTOUT_SPI_MAX_BYTES > 255
+#error "SHIFTOUT_SPI_MAX_BYTES must not exceed 255"
+#endif
+
+/// @brief Data pin value to select hardware SPI (MOSI/SCK) for a chain
+#define SPI_PIN 0xFD
+
+/// @brief Descriptor of one chain of shift registers
+struct ShiftChain_t
+{
+  uint16_t first;     // first byte in the output planes
+  uint16_t pins;      // number of outputs
+  uint8_t mask;       // bit mask of the data pin
+};
+
+class ShiftSPI_;
+
+/// @brief Common base of ShiftOut and LedShift: output states in bit planes (bit (pin & 7) of byte (pin >> 3)),
+/// sent to one or more chains of shift registers sharing clock and latch. Chains on data pins of the same port
+/// are clocked in parallel, so an update takes the time of the longest chain.
+class ShiftChains
 {
 public:
-  /// @brief Constructor, setup shift register and set pins
-  /// @param pin_DAI DAI pin (data)
-  /// @param pin_DCK DCL pin (clock)
-  /// @param pin_LAT LAT pin (latch)
-  /// @param pins Number of pins for cascaded shift registers (max 64)
-  ShiftOut(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint8_t pins = 16);
+  /// @brief Add a chain of shift registers clocked in parallel to the first one
+  /// @param pin_DAI Data pin of the chain, must be on the same port as the data pin of the first chain
+  /// @param pins Number of outputs of the chain
+  /// @return Pin number of the first output of the chain (outputs of a chain start at a multiple of 8),
+  /// -1 when the capacity or the number of chains is exceeded, the port differs or hardware SPI is used
+  int addChain(uint8_t pin_DAI, uint16_t pins);
+
+  /// @brief Get the number of pin numbers in use
+  /// @return Pin numbers 0 to pins() - 1 can be set
+  uint16_t pins() { return _pins; }
+
+  // planes and chains belong to the derived object, a copy would write into the buffers of the original
+  ShiftChains(const ShiftChains &) = delete;
+  ShiftChains &operator=(const ShiftChains &) = delete;
+
+protected:
+  ShiftChains(uint8_t *planes, uint8_t numPlanes, uint16_t capacity, ShiftChain_t *chains, uint8_t maxChains,
+              uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins);
+  bool _send();
+  uint8_t _byte(uint16_t index);
+  uint8_t _chainByte(uint8_t chain, uint16_t index);
+  uint8_t *_plane;
+  uint8_t _numPlanes;
+  uint8_t _phase;       // plane n > 0 is shown when bit n - 1 is set
+  uint16_t _planeBytes;
+  ShiftChain_t *_chain;
+  uint8_t _maxChains;
+  uint8_t _numChains;
+  uint8_t _pin_DAI;
+  uint8_t _pin_DCK;
+  uint8_t _pin_LAT;
+  uint16_t _pins;
+  bool _update;
+
+  friend class ShiftSPI_;
+};
+
+#if SHIFTOUT_SPI
+/// @brief Hardware SPI transmitter shared by all ShiftOut and LedShift chains on the SPI interface,
+/// one chain is sent at a time. The bus is used exclusively while busy(): other SPI users must wait until
+/// busy() is false before their own transactions, the SPI library does not check it. When another library
+/// has called SPI.usingInterrupt() for an interrupt that can only be blocked globally, the chain is sent
+/// synchronously instead.
+class ShiftSPI_
+{
+public:
+  /// @brief Start sending the outputs of a chain, highest byte first, and latch it after the last byte.
+  /// The outputs are copied into a frame buffer, so changes made while the transfer is running are sent with
+  /// the next one and each latched frame is consistent. Returns immediately, the bytes are sent from the
+  /// SPI interrupt.
+  /// @param chain Outputs to send
+  /// @param pinLatch Latch pin of the chain
+  /// @return true when started, false when another chain is still being sent (try again later)
+  bool send(ShiftChains *chain, uint8_t pinLatch);
 
-  /// @brief Set one outpot  to a display mode
-  /// @param pin Pin to set (0-64)
+  /// @brief Check for a transfer in progress
+  /// @return true while a chain is being sent
+  bool busy() { return _busy; }
+
+  /// @brief Send the next byte or latch the chain, called from SPI interrupt
+  void isr();
+
+private:
+  bool _begun;
+  uint8_t _frame[SHIFTOUT_SPI_MAX_BYTES];
+  volatile uint8_t _remaining;
+  volatile bool _busy;
+  volatile uint8_t *_latchReg;
+  uint8_t _latchMask;
+};
+
+/// @brief Instance of the class for system wide use
+extern ShiftSPI_ ShiftSPI;
+#endif
+
+/// @brief Outputs of shift registers (74HC595, DM13A), use ShiftOut or ShiftOutN
+class ShiftOutBase : public ShiftChains
+{
+public:
+  /// @brief Set one output
+  /// @param pin Pin to set (0 to pins() - 1)
   /// @param state State to set (HIGH/LOW)
-  void setPin(uint8_t pin, bool state);
+  void setPin(uint16_t pin, bool state);
 
   /// @brief Set state for all outputs
   /// @param state State to set (HIGH/LOW)
@@ -25,14 +135,44 @@ public:
   /// @brief Real time handling, call cyclic in loop()
   void handle();
 
+protected:
+  ShiftOutBase(uint8_t *state, uint16_t capacity, ShiftChain_t *chains, uint8_t maxChains,
+               uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins);
+};
+
+/// @brief Shift register outputs with capacity set at compile time
+/// @tparam PINS Maximum number of outputs of all chains
+/// @tparam CHAINS Maximum number of chains clocked in parallel (max. 8)
+template <uint16_t PINS, uint8_t CHAINS = 1>
+class ShiftOutN : public ShiftOutBase
+{
+  static_assert(CHAINS > 0 && CHAINS <= 8, "ShiftOutN supports 1 to 8 chains");
+
+public:
+  /// @brief Constructor, setup shift register and set pins
+  /// @param pin_DAI DAI pin (data) of the first chain, SPI_PIN for hardware SPI (needs SHIFTOUT_SPI)
+  /// @param pin_DCK DCL pin (clock), ignored for hardware SPI
+  /// @param pin_LAT LAT pin (latch)
+  /// @param pins Number of pins of the first chain (max PINS)
+  ShiftOutN(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins = 16)
+      : ShiftOutBase(_state, PINS, _chains, CHAINS, pin_DAI, pin_DCK, pin_LAT, pins) {}
+
 private:
-  void _send();
-  uint8_t _pin_DAI;
-  uint8_t _pin_DCK;
-  uint8_t _pin_LAT;
-  uint8_t _pins;
-  uint8_t _state[8];
-  bool _update;
+  uint8_t _state[(PINS + 7) / 8];
+  ShiftChain_t _chains[CHAINS];
+};
+
+/// @brief Class to encapsulate a DM13A LED driver IC
+class ShiftOut : public ShiftOutN<64>
+{
+public:
+  /// @brief Constructor, setup shift register and set pins
+  /// @param pin_DAI DAI pin (data), SPI_PIN for hardware SPI (needs SHIFTOUT_SPI)
+  /// @param pin_DCK DCL pin (clock), ignored for hardware SPI
+  /// @param pin_LAT LAT pin (latch)
+  /// @param pins Number of pins for cascaded shift registers (max 64, use ShiftOutN for more)
+  ShiftOut(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins = 16)
+      : ShiftOutN<64>(pin_DAI, pin_DCK, pin_LAT, pins) {}
 };
 
 #endif
@@ -2,6 +2,15 @@
 #define Switch_h
 #include <Arduino.h>
 #include <DigitalIn.h>
+#include <InputEvents.h>
+#include <directIO.h>
+
+/// @brief Dataref binding of a switch, one value per switch position
+struct SwitchValue_t
+{
+  float value;        // current value, watched by XPLDirect
+  float pos[3];       // value for each position, indexed by switch state
+};
 
 /// @brief Class for a simple on/off switch with debouncing and XPLDirect command handling.
 class Switch
@@ -52,9 +61,26 @@ public:
   /// @brief Get XPLDirect command for last transition of Switch
   /// @return Handle of the last command
   int getCommand() { return  (_state == switchOn ? _cmdOn : _cmdOff); };
+
+  /// @brief Bind the Switch to a writable dataref. The value for the current position is sent on every
+  /// change, when the dataref is assigned after connect and on every refresh request from XPlane.
+  /// @param dataRefName Name of the dataref
+  /// @param onValue Value for Switch on
+  /// @param offValue Value for Switch off
+  /// @param index Index for array datarefs, -1 for plain datarefs
+  /// @return true when successful, false when the dataref could not be registered
+  bool setDataRef(XPString_t *dataRefName, float onValue = 1.0, float offValue = 0.0, int index = -1);
   
   /// @brief Process all transitions to XPLDirect
-  void processCommand();
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+  /// @brief Queue transitions in InputEvents as soon as handle() detects them, so none is collapsed
+  /// and each event carries the time of its detection. processCommand() and queueCommand() are not needed then.
+  /// @param enable true: queue mode, false: keep transitions for processCommand() or queueCommand()
+  void setQueueMode(bool enable) { _queued = enable; };
   
   /// @brief Check Status of Switch and translate to float value
   /// @param onValue Value to return when Switch is set to on
@@ -62,19 +88,51 @@ public:
   /// @return Returned value
   float value(float onValue, float offValue) { return isOn() ? onValue : offValue; };
 
-private:
+protected:
+  void _processCommand(bool queue);
   enum SwState_t
   {
     switchOff,
     switchOn
   };
+  void _update(bool input);
   uint8_t _nExp;
   uint8_t _pin;
-  uint8_t _debounce;
+  Debounce_t _debounce;
   uint8_t _state;
   bool _transition;
+  bool _queued;
   int _cmdOff;
   int _cmdOn;
+  SwitchValue_t *_value;
+};
+
+/// @brief Class for a simple on/off switch reading its input from a compile-time input source instead of DigitalIn,
+/// so the input read compiles to a single bit test.
+/// @tparam Input Class with static bool read() returning true when on, e.g. InputBank<...>::Input<0, 3>
+template <class Input>
+class StaticSwitch : public Switch
+{
+public:
+  /// @brief Constructor
+  StaticSwitch() : Switch(NOT_USED, NOT_USED) {};
+
+  /// @brief Handle realtime. Read input and evaluate any transitions.
+  void handle()     { if (!debouncing(_debounce)) _update(Input::read()); };
+
+  /// @brief Handle realtime and process XPLDirect commands
+  void handleXP()   { handle(); processCommand(); };
+};
+
+/// @brief Class for a simple on/off switch on a direct Arduino pin known at compile time.
+/// Port and mask are resolved by the compiler, a read is a single port access.
+/// @tparam PIN Arduino pin number
+template <uint8_t PIN>
+class DirectSwitch : public StaticSwitch<PinInput<PIN>>
+{
+public:
+  /// @brief Constructor, sets pin to input with pullup
+  DirectSwitch() { PinInput<PIN>::begin(); };
 };
 
 /// @brief Class for an on/off/on switch with debouncing and XPLDirect command handling.
@@ -140,8 +198,26 @@ public:
   /// @return Handle of the last command
   int getCommand();
 
+  /// @brief Bind the Switch to a writable dataref. The value for the current position is sent on every
+  /// change, when the dataref is assigned after connect and on every refresh request from XPlane.
+  /// @param dataRefName Name of the dataref
+  /// @param on1Value Value for position on1
+  /// @param offValue Value for position off
+  /// @param on2Value Value for position on2
+  /// @param index Index for array datarefs, -1 for plain datarefs
+  /// @return true when successful, false when the dataref could not be registered
+  bool setDataRef(XPString_t *dataRefName, float on1Value, float offValue, float on2Value, int index = -1);
+
   /// @brief Process all transitions to XPLDirect
-  void processCommand();
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+  /// @brief Queue transitions in InputEvents as soon as handle() detects them, so none is collapsed
+  /// and each event carries the time of its detection. processCommand() and queueCommand() are not needed then.
+  /// @param enable true: queue mode, false: keep transitions for processCommand() or queueCommand()
+  void setQueueMode(bool enable) { _queued = enable; };
 
   /// @brief Check Status of Switch and translate to float value
   /// @param on1Value Value to return when Switch is set to on1
@@ -151,6 +227,7 @@ public:
   float value(float on1Value, float offValue, float on2value) { return (isOn1() ? on1Value : isOn2() ? on2value : offValue); };
 
 private:
+  void _processCommand(bool queue);
   enum SwState_t
   {
     switchOff,
@@ -161,12 +238,99 @@ private:
   uint8_t _pin1;
   uint8_t _pin2;
   uint8_t _lastState;
-  uint8_t _debounce;
+  Debounce_t _debounce;
   uint8_t _state;
   bool _transition;
+  bool _queued;
   int _cmdOff;
   int _cmdOn1;
   int _cmdOn2;
+  SwitchValue_t *_value;
+};
+
+/// @brief Class for a rotary selector switch with 2-16 positions wired to consecutive channels of one expander
+/// (magnetos, ignition, mode selectors). The position is decoded from the expander word in constant time,
+/// changes are debounced and mapped to up/down commands, one command per position or a dataref value.
+class RotarySwitch
+{
+public:
+  /// @brief Constructor. Connect the switch to consecutive expander channels.
+  /// @param nExp expander number (from DigitalIn initialization order)
+  /// @param firstChannel channel on the expander (0-15) for position 0
+  /// @param positions number of positions (2-16), position n is on channel firstChannel + n.
+  /// Limited so all positions fit the 16 channels of the expander.
+  RotarySwitch(uint8_t nExp, uint8_t firstChannel, uint8_t positions);
+
+  /// @brief Handle realtime. Read inputs and evaluate any transitions.
+  void handle();
+
+  /// @brief Handle realtime and process XPLDirect commands
+  void handleXP() { handle(); processCommand(); };
+
+  /// @brief Get current position. Between two detents the last position is kept.
+  /// @return Position (0 to positions - 1)
+  uint8_t position() { return _pos; };
+
+  /// @brief Set XPLDirect commands for turning the switch. Skipped positions are sent as repeat count.
+  /// @param cmdUp Command handle for turning to a higher position as returned by XP.registerCommand()
+  /// @param cmdDown Command handle for turning to a lower position as returned by XP.registerCommand()
+  void setCommand(int cmdUp, int cmdDown) { _cmdUp = cmdUp; _cmdDown = cmdDown; };
+
+  /// @brief Set XPLDirect commands for turning the switch. Skipped positions are sent as repeat count.
+  /// @param cmdNameUp Command for turning to a higher position
+  /// @param cmdNameDown Command for turning to a lower position
+  void setCommand(XPString_t *cmdNameUp, XPString_t *cmdNameDown)
+    { _cmdUp = XP.registerCommand(cmdNameUp); _cmdDown = XP.registerCommand(cmdNameDown); };
+
+  /// @brief Set XPLDirect command for one position, sent when the switch is moved there.
+  /// Takes precedence over the up/down commands.
+  /// @param pos Position
+  /// @param cmd Command handle as returned by XP.registerCommand()
+  /// @return true when successful, false for invalid position
+  bool setPositionCommand(uint8_t pos, int cmd);
+
+  /// @brief Set XPLDirect command for one position, sent when the switch is moved there.
+  /// @param pos Position
+  /// @param cmdName Command for this position
+  /// @return true when successful, false for invalid position
+  bool setPositionCommand(uint8_t pos, XPString_t *cmdName) { return setPositionCommand(pos, XP.registerCommand(cmdName)); };
+
+  /// @brief Bind the switch to a writable dataref. The value for the current position is sent on every
+  /// change, when the dataref is assigned after connect and on every refresh request from XPlane.
+  /// @param dataRefName Name of the dataref
+  /// @param values Value for each position (array must stay valid), NULL sends the position number
+  /// @param index Index for array datarefs, -1 for plain datarefs
+  /// @return true when successful, false when the dataref could not be registered
+  bool setDataRef(XPString_t *dataRefName, const float *values = NULL, int index = -1);
+
+  /// @brief Process all transitions to XPLDirect
+  void processCommand()         { _processCommand(false); };
+
+  /// @brief Queue all transitions in InputEvents instead of sending them to XPLDirect
+  void queueCommand()           { _processCommand(true); };
+
+  /// @brief Queue transitions in InputEvents as soon as handle() detects them, so none is collapsed
+  /// and each event carries the time of its detection. processCommand() and queueCommand() are not needed then.
+  /// @param enable true: queue mode, false: keep transitions for processCommand() or queueCommand()
+  void setQueueMode(bool enable) { _queued = enable; };
+
+protected:
+  void _processCommand(bool queue);
+  void _update(uint16_t input);
+  uint8_t _nExp;
+  uint8_t _first;
+  uint8_t _positions;
+  uint8_t _pos;
+  uint8_t _lastPos;
+  Debounce_t _debounce;
+  bool _transition;
+  bool _queued;
+  bool _valid;          // start position read
+  int _cmdUp;
+  int _cmdDown;
+  int *_cmdPos;
+  const float *_values;
+  float *_value;
 };
 
 #endif
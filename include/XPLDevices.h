@@ -9,6 +9,8 @@
 #include <LedShift.h>
 #include <Timer.h>
 #include <DigitalIn.h>
+#include <InputEvents.h>
+#include <InputBank.h>
 #include <AnalogIn.h>
 
 #endif
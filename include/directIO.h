@@ -6,14 +6,80 @@
 
 #pragma once
 
-#ifdef ARDUINO_ARCH_AVR
-
 #include <Arduino.h>
 
+#ifdef ARDUINO_ARCH_AVR
+
 void directPinMode(uint8_t port, uint8_t pinMsk, uint8_t mode);
 void directPinOut(uint8_t port, uint8_t pinMsk, uint8_t val);
 int  directPinin(uint8_t port, uint8_t pinMsk);
 
 #endif
 
+// Pin to port mapping known at compile time for the common boards, so FastPin compiles to single in/out/sbi/cbi
+// instructions instead of PROGMEM table lookups. Other boards use the runtime tables of the Arduino core.
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+#define FASTPIN_CONST 1
+// Address of the PINx register of a pin (PD: 0-7, PB: 8-13, PC: 14-19)
+constexpr uint16_t fastPinReg(uint8_t pin)  { return pin < 8 ? 0x29 : pin < 14 ? 0x23 : 0x26; }
+constexpr uint8_t  fastPinMask(uint8_t pin) { return 1 << (pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14); }
+constexpr bool     fastPinValid(uint8_t pin) { return pin < 20; }
+#elif defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+#define FASTPIN_CONST 1
+// PINA-PING are in I/O space, PINH-PINL in extended I/O space (there is no port I)
+constexpr uint16_t fastPortReg(char port)   { return port < 'H' ? 0x20 + 3 * (port - 'A') : 0x100 + 3 * (port - 'H' - (port > 'I' ? 1 : 0)); }
+constexpr uint16_t fastPinReg(uint8_t pin)  { return fastPortReg("EEEEGEHHHHBBBBJJHHDDDDAAAAAAAACCCCCCCCDGGGLLLLLLLLBBBBFFFFFFFFKKKKKKKK"[pin]); }
+constexpr uint8_t  fastPinMask(uint8_t pin) { return 1 << ("0145533456456710103210012345677654321072107654321032100123456701234567"[pin] - '0'); }
+constexpr bool     fastPinValid(uint8_t pin) { return pin < 70; }
+#else
+#define FASTPIN_CONST 0
+#endif
+
+/// @brief Access to a digital pin whose number is known at compile time
+/// @tparam PIN Arduino pin number
+template <uint8_t PIN>
+struct FastPin
+{
+#if FASTPIN_CONST
+  static_assert(fastPinValid(PIN), "Invalid pin number");
+  static volatile uint8_t &in()   { return *(volatile uint8_t *)fastPinReg(PIN); }
+  static volatile uint8_t &out()  { return *(volatile uint8_t *)(fastPinReg(PIN) + 2); }
+
+  static void mode(uint8_t mode)  { directPinMode(digitalPinToPort(PIN), fastPinMask(PIN), mode); }
+  static bool read()              { return (in() & fastPinMask(PIN)) != 0; }
+  static void write(uint8_t val)
+  {
+    if (fastPinReg(PIN) + 2 < 0x40)
+    {
+      // single sbi/cbi instruction, atomic
+      val == LOW ? (out() &= ~fastPinMask(PIN)) : (out() |= fastPinMask(PIN));
+    }
+    else
+    {
+      uint8_t oldSREG = SREG;
+      cli();
+      val == LOW ? (out() &= ~fastPinMask(PIN)) : (out() |= fastPinMask(PIN));
+      SREG = oldSREG;
+    }
+  }
+#elif defined(ARDUINO_ARCH_AVR)
+  static void mode(uint8_t mode)  { directPinMode(digitalPinToPort(PIN), digitalPinToBitMask(PIN), mode); }
+  static bool read()              { return (*portInputRegister(digitalPinToPort(PIN)) & digitalPinToBitMask(PIN)) != 0; }
+  static void write(uint8_t val)  { directPinOut(digitalPinToPort(PIN), digitalPinToBitMask(PIN), val); }
+#else
+  static void mode(uint8_t mode)  { pinMode(PIN, mode); }
+  static bool read()              { return digitalRead(PIN) == HIGH; }
+  static void write(uint8_t val)  { digitalWrite(PIN, val); }
+#endif
+};
+
+/// @brief Input source for a direct Arduino pin with pullup (negative logic: read() is true when pin is at GND)
+/// @tparam PIN Arduino pin number
+template <uint8_t PIN>
+struct PinInput
+{
+  static void begin()             { FastPin<PIN>::mode(INPUT_PULLUP); }
+  static bool read()              { return !FastPin<PIN>::read(); }
+};
+
 // directIO.h
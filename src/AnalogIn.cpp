@@ -1,17 +1,143 @@
+#include <XPLDirect.h>
 #include "AnalogIn.h"
+#if ANALOGIN_USE_EEPROM
+#include <EEPROM.h>
+#endif
 
 #define FULL_SCALE ((1 << AD_RES) - 1)
 #define HALF_SCALE (1 << (AD_RES - 1))
+#define CAL_SAMPLES 64
+// smallest range (digits of AD_RES bits) stored or loaded as calibration, an axis not yet moved through its
+// range by the automatic calibration is not stored
+#define CAL_MIN_SPAN (FULL_SCALE / 4)
 
-AnalogIn::AnalogIn(uint8_t pin, Analog_t type)
+// consecutive samples beyond the range needed to widen it, so single noise spikes are ignored
+#define EXTREME_SAMPLES 4
+// a bipolar input rests when the samples of a block spread by REST_SPREAD digits at most; after REST_BLOCKS
+// resting blocks in a row near the center, the center moves one digit towards their mean
+#define REST_SAMPLES 64
+#define REST_SPREAD 3
+#define REST_BLOCKS 8
+
+// conversions of a multiplexed input repeated because DigitalIn switched the selector pins meanwhile; the last
+// one is taken anyway, so scan rates faster than a conversion cannot stall the analog inputs
+#define MUX_RETRIES 3
+
+// unchanged samples plus filter time constants until a resting input sends its final value to the dataref
+#define SETTLE_SAMPLES 16
+#define SETTLE_TIME_CONSTS 8
+
+AnalogIn *AnalogIn::_mux[ANALOGIN_MUX_MAX_NUMBER];
+uint8_t AnalogIn::_numMux = 0;
+
+#if ANALOGIN_USE_EEPROM
+#define NO_SLOT 255
+
+// calibration record in EEPROM, values in digits of AD_RES bits
+struct AnalogCal_t
+{
+  uint16_t key;       // analog pin | multiplexer channel << 8, 0xFFFF = free
+  uint16_t min;
+  uint16_t max;
+  uint16_t center;
+  uint8_t check;
+};
+
+AnalogIn *AnalogIn::_calWriter = NULL;
+uint8_t AnalogIn::_calBuffer[sizeof(AnalogCal_t)];
+uint8_t AnalogIn::_calIndex = 0;
+uint32_t AnalogIn::_calClaimed = 0;
+
+static uint8_t calCheck(const AnalogCal_t &cal)
+{
+  const uint8_t *bytes = (const uint8_t *)&cal;
+  uint8_t check = 0xA5;
+  for (uint8_t i = 0; i < offsetof(AnalogCal_t, check); i++)
+  {
+    check = (check << 1 | check >> 7) ^ bytes[i];
+  }
+  return check;
+}
+#endif
+
+#if ANALOGIN_SEQUENCER
+AnalogIn *AnalogIn::_slot[ANALOGIN_MAX_NUMBER];
+uint8_t AnalogIn::_numSlots = 0;
+volatile uint8_t AnalogIn::_current = 0;
+volatile bool AnalogIn::_running = false;
+uint8_t AnalogIn::_muxChanges = 0;
+uint8_t AnalogIn::_retries = 0;
+#endif
+
+#ifdef ARDUINO_ARCH_AVR
+// ADC channel of an analog pin, accepts pin or channel numbers like analogRead()
+static uint8_t adcChannel(uint8_t pin)
+{
+#if defined(analogPinToChannel)
+#if defined(__AVR_ATmega32U4__)
+  if (pin >= 18) pin -= 18;
+#endif
+  return analogPinToChannel(pin);
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+  return (pin >= 54) ? pin - 54 : pin;
+#else
+  return (pin >= 14) ? pin - 14 : pin;
+#endif
+}
+#endif
+
+AnalogIn::AnalogIn(uint8_t pin, Analog_t type) : AnalogIn(pin, NOT_USED, type, 0.0)
+{
+}
+
+AnalogIn::AnalogIn(uint8_t pin, Analog_t type, float timeConst) : AnalogIn(pin, NOT_USED, type, timeConst)
+{
+}
+
+AnalogIn::AnalogIn(uint8_t pin, uint8_t muxChannel, Analog_t type, float timeConst)
 {
   _pin = pin;
+  _muxChannel = muxChannel;
+#if ANALOGIN_FIXED_POINT
+  _filtered = 0;
+  _filterK = 0;
+#else
+  _value = 0.0;
+#endif
   _filterConst = 1.0;
   _scale = 1.0;
   _min = 0;
   _max = FULL_SCALE;
   _type = type;
   pinMode(_pin, INPUT);
+  _dataRef = NULL;
+  _curve = NULL;
+  _curveShift = 0;
+  _osBits = 0;
+  _acc = 0;
+  _accCount = 0;
+  _lastSample = 0;
+  _samplePeriod = 0;
+  _fresh = false;
+#ifdef ARDUINO_ARCH_AVR
+  _channel = adcChannel(pin);
+#endif
+  _calCount = 0;
+  _calValid = false;
+  _tracking = false;
+  _beyond = 0;
+  _restCount = 0;
+  _restBlocks = 0;
+  if (_muxChannel != NOT_USED)
+  {
+    _addMux();
+  }
+#if ANALOGIN_SEQUENCER
+  else if (_numSlots < ANALOGIN_MAX_NUMBER && !_running)
+  {
+    _slot[_numSlots++] = this;
+  }
+#endif
   if (_type == bipolar)
   {
     _offset = HALF_SCALE;
@@ -20,26 +146,209 @@ AnalogIn::AnalogIn(uint8_t pin, Analog_t type)
   {
     _offset = 0;
   }
+#if ANALOGIN_USE_EEPROM
+  _calDirty = false;
+  _calSaved = 0;
+  _loadCalibration();
+#endif
   _calcScales();
+  // until the first sample is complete raw() reads the center (bipolar) or the minimum (unipolar), matching value()
+  _sample = _offset;
+  if (timeConst > 0)
+  {
+    _filterConst = 1.0 / timeConst;
+  }
+#if ANALOGIN_FIXED_POINT
+  // 1.0 does not fit Q16 and means no filtering anyway
+  _filterK = (_filterConst >= 1.0) ? 0 : (uint16_t)(_filterConst * 65536.0 + 0.5);
+#endif
 }
 
-AnalogIn::AnalogIn(uint8_t pin, Analog_t type, float timeConst) : AnalogIn(pin, type)
+// keep multiplexed inputs sorted by channel, then by analog pin
+void AnalogIn::_addMux()
 {
-  if (timeConst > 0)
+  if (_numMux >= ANALOGIN_MUX_MAX_NUMBER)
   {
-    _filterConst = 1.0 / timeConst;
+    return;
+  }
+#if ANALOGIN_SEQUENCER
+  if (_running)
+  {
+    return;
+  }
+#endif
+  uint16_t key = (_muxChannel << 8) | _pin;
+  uint8_t i = _numMux++;
+  while (i > 0 && ((_mux[i - 1]->_muxChannel << 8) | _mux[i - 1]->_pin) > key)
+  {
+    _mux[i] = _mux[i - 1];
+    i--;
   }
+  _mux[i] = this;
 }
 
+// filter and dataref follow new samples only, so the time constant counts samples
 void AnalogIn::handle()
 {
-  int _raw = raw();
-  _value = (_filterConst * _raw * (_raw >= 0 ? _scalePos : _scaleNeg)) + (1.0 - _filterConst) * _value;
+  if (_acquire())
+  {
+    uint32_t now = micros();
+    _samplePeriod = _lastSample ? now - _lastSample : 0;
+    _lastSample = now;
+    if (_calCount > 0)
+    {
+      _calSum += _read();
+      if (--_calCount == 0)
+      {
+        _offset = _calSum / CAL_SAMPLES;
+        _calChanged(true);
+      }
+    }
+    else if (_tracking)
+    {
+      _track(_read());
+    }
+    _update(raw());
+    if (_dataRef)
+    {
+      _updateDataRef();
+    }
+  }
+#if ANALOGIN_USE_EEPROM
+  _saveCalibration();
+#endif
+}
+
+// take one conversion into the block (or check the sequencer or handleMux()), true when a new decimated sample
+// is complete
+bool AnalogIn::_acquire()
+{
+#if ANALOGIN_SEQUENCER
+  if (_running || _muxChannel != NOT_USED)
+  {
+    uint8_t oldSREG = SREG;
+    cli();
+    bool fresh = _fresh;
+    _fresh = false;
+    SREG = oldSREG;
+    return fresh;
+  }
+#else
+  if (_muxChannel != NOT_USED)
+  {
+    bool fresh = _fresh;
+    _fresh = false;
+    return fresh;
+  }
+#endif
+  return _accumulate(analogRead(_pin));
+}
+
+// add one conversion to the block, true when a new decimated sample is complete
+bool AnalogIn::_accumulate(uint16_t conversion)
+{
+  _acc += conversion;
+  if (++_accCount < (1U << (2 * _osBits)))
+  {
+    return false;
+  }
+  _sample = _acc >> _osBits;
+  _acc = 0;
+  _accCount = 0;
+  return true;
+}
+
+#if ANALOGIN_FIXED_POINT
+// normalize to Q15, first order low pass in Q30: y += k * (x - y)
+void AnalogIn::_update(int raw)
+{
+  int32_t x = ((int32_t)raw * (int32_t)(raw >= 0 ? _kPos : _kNeg)) >> 16;
+  if (_curve)
+  {
+    x = _applyCurve(x);
+  }
+  if (_filterK == 0)
+  {
+    _filtered = x * 32768;
+    return;
+  }
+  // (diff * k) >> 16 as two 16x16 bit multiplies, diff * k would overflow 32 bits
+  int32_t diff = x * 32768 - _filtered;
+  _filtered += (int32_t)(int16_t)(diff >> 16) * _filterK + (((uint32_t)(uint16_t)diff * _filterK) >> 16);
+}
+#else
+void AnalogIn::_update(int raw)
+{
+  float x = raw * (raw >= 0 ? _scalePos : _scaleNeg);
+  if (_curve)
+  {
+    x = _applyCurve((int16_t)(x * _curveIn)) * _curveOut;
+  }
+  _value = (_filterConst * x) + (1.0 - _filterConst) * _value;
+}
+#endif
+
+// map Q15 input to the curve: the upper bits select the segment, the lower bits interpolate within it
+int16_t AnalogIn::_applyCurve(int16_t x)
+{
+  uint16_t u = (_type == bipolar) ? (uint16_t)(x + 32768) >> 1 : max(x, 0);
+  uint8_t segment = u >> _curveShift;
+  uint16_t frac = u & ((1U << _curveShift) - 1);
+  int16_t y0 = (int16_t)pgm_read_word(&_curve[segment]);
+  int16_t y1 = (int16_t)pgm_read_word(&_curve[segment + 1]);
+  return y0 + (int16_t)(((int32_t)(y1 - y0) * frac) >> _curveShift);
+}
+
+bool AnalogIn::setCurve(const int16_t *points, uint8_t segmentsLog2)
+{
+  if (segmentsLog2 > 8)
+  {
+    return false;
+  }
+  _curveShift = 15 - segmentsLog2;
+  _curve = points;
+  return true;
 }
 
 int AnalogIn::raw()
 {
-  return constrain(analogRead(_pin), (int16_t)_min, (int16_t)_max) - _offset;
+  return constrain((int16_t)_read(), (int16_t)_min, (int16_t)_max) - _offset;
+}
+
+// latest decimated sample, written by handle() or the sequencer interrupt
+uint16_t AnalogIn::_read()
+{
+#if ANALOGIN_SEQUENCER
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t sample = _sample;
+  SREG = oldSREG;
+  return sample;
+#else
+  return _sample;
+#endif
+}
+
+void AnalogIn::setOversampling(uint8_t bits)
+{
+  bits = min(bits, 5);      // keeps 15 bit samples within int
+#ifdef ARDUINO_ARCH_AVR
+  uint8_t oldSREG = SREG;
+  cli();
+#endif
+  int8_t shift = bits - _osBits;
+  _osBits = bits;
+  _acc = 0;
+  _accCount = 0;
+  _sample = (shift >= 0) ? (_sample << shift) : (_sample >> -shift);
+#ifdef ARDUINO_ARCH_AVR
+  SREG = oldSREG;
+#endif
+  // keep range and calibration in the new resolution
+  _min = (shift >= 0) ? (_min << shift) : (_min >> -shift);
+  _max = (shift >= 0) ? (_max << shift) : (_max >> -shift);
+  _offset = (shift >= 0) ? (_offset << shift) : (_offset >> -shift);
+  _calcScales();
 }
 
 void AnalogIn::calibrate()
@@ -48,23 +357,198 @@ void AnalogIn::calibrate()
   {
     return;
   }
-  long sum = 0;
-  for (int i = 0; i < 64; i++)
+  _calSum = 0;
+  _calCount = CAL_SAMPLES;
+}
+
+void AnalogIn::setAutoCalibrate(bool enable)
+{
+  _tracking = enable;
+  _beyond = 0;
+  _restCount = 0;
+  _restBlocks = 0;
+}
+
+void AnalogIn::saveCalibration()
+{
+#if ANALOGIN_USE_EEPROM
+  if (_calValid && _max - _min >= (CAL_MIN_SPAN << _osBits))
+  {
+    _calDirty = true;
+  }
+#endif
+}
+
+// widen the range to extremes reached by several samples in a row, let the center of a bipolar input follow
+// slow drift while the input rests near it
+void AnalogIn::_track(uint16_t sample)
+{
+  if (!_calValid)
+  {
+    _min = sample;
+    _max = sample;
+    _offset = sample;
+    _calChanged(true);
+    return;
+  }
+  int8_t dir = (sample > _max) ? 1 : (sample < _min) ? -1 : 0;
+  if (dir == 0)
+  {
+    _beyond = 0;
+  }
+  else
+  {
+    // widen only as far as all samples of the run reached
+    if (_beyond * dir <= 0)
+    {
+      _beyond = 0;
+      _candidate = sample;
+    }
+    else if ((dir > 0) == (sample < _candidate))
+    {
+      _candidate = sample;
+    }
+    _beyond += dir;
+    if (_beyond >= EXTREME_SAMPLES || _beyond <= -EXTREME_SAMPLES)
+    {
+      if (dir > 0)
+      {
+        _max = _candidate;
+      }
+      else
+      {
+        _min = _candidate;
+      }
+      if (_type == unipolar)
+      {
+        _offset = _min;
+      }
+      _beyond = 0;
+      _calChanged(true);
+    }
+  }
+  if (_type == unipolar)
+  {
+    return;
+  }
+  if (_restCount == 0)
   {
-    sum += analogRead(_pin);
+    _restMin = sample;
+    _restMax = sample;
+    _restSum = 0;
   }
-  _offset = (int)(sum / 64);
+  _restMin = min(_restMin, sample);
+  _restMax = max(_restMax, sample);
+  _restSum += sample;
+  if (++_restCount < REST_SAMPLES)
+  {
+    return;
+  }
+  _restCount = 0;
+  uint16_t mean = (_restSum + REST_SAMPLES / 2) / REST_SAMPLES;
+  if (_restMax - _restMin > (REST_SPREAD << _osBits) || abs((int32_t)mean - _offset) > (_max - _min) / 64)
+  {
+    _restBlocks = 0;
+    return;
+  }
+  if (++_restBlocks >= REST_BLOCKS)
+  {
+    _restBlocks = 0;
+    if (mean != _offset)
+    {
+      _offset += (mean > _offset) ? 1 : -1;
+      _calChanged(false);       // stored with the next range change or saveCalibration()
+    }
+  }
+}
+
+// range or center changed by calibration: rescale and, if requested, schedule the calibration for storage
+void AnalogIn::_calChanged(bool store)
+{
+  _calValid = true;
   _calcScales();
+#if ANALOGIN_USE_EEPROM
+  if (store && _max - _min >= (CAL_MIN_SPAN << _osBits))
+  {
+    _calDirty = true;
+  }
+#else
+  (void)store;
+#endif
+}
+
+#if ANALOGIN_USE_EEPROM
+// find the record of this input, or claim a free one for saving
+void AnalogIn::_loadCalibration()
+{
+  uint16_t key = (_muxChannel << 8) | _pin;
+  _calSlot = NO_SLOT;
+  for (uint8_t slot = 0; slot < ANALOGIN_EEPROM_SLOTS; slot++)
+  {
+    if (_calClaimed & (1UL << slot))
+    {
+      continue;
+    }
+    AnalogCal_t cal;
+    EEPROM.get(ANALOGIN_EEPROM_ADDRESS + slot * sizeof(AnalogCal_t), cal);
+    if (cal.key == key && cal.check == calCheck(cal) && cal.min <= cal.center && cal.center <= cal.max &&
+        cal.max - cal.min >= CAL_MIN_SPAN)
+    {
+      _calSlot = slot;
+      _min = cal.min;
+      _max = cal.max;
+      _offset = (_type == unipolar) ? cal.min : cal.center;
+      _calValid = true;
+      break;
+    }
+    if (cal.key == 0xFFFF && _calSlot == NO_SLOT)
+    {
+      _calSlot = slot;
+    }
+  }
+  if (_calSlot != NO_SLOT)
+  {
+    _calClaimed |= (1UL << _calSlot);
+  }
+}
+
+// write a changed calibration, one byte per call while the EEPROM is ready, so handle() never waits
+void AnalogIn::_saveCalibration()
+{
+  if (_calWriter == NULL && _calDirty && _calSlot != NO_SLOT && millis() - _calSaved >= ANALOGIN_EEPROM_INTERVAL)
+  {
+    AnalogCal_t cal;
+    cal.key = (_muxChannel << 8) | _pin;
+    cal.min = _min >> _osBits;
+    cal.max = _max >> _osBits;
+    cal.center = _offset >> _osBits;
+    cal.check = calCheck(cal);
+    memcpy(_calBuffer, &cal, sizeof(AnalogCal_t));
+    _calWriter = this;
+    _calIndex = 0;
+    _calDirty = false;
+  }
+  if (_calWriter != this || !eeprom_is_ready())
+  {
+    return;
+  }
+  EEPROM.update(ANALOGIN_EEPROM_ADDRESS + _calSlot * sizeof(AnalogCal_t) + _calIndex, _calBuffer[_calIndex]);
+  if (++_calIndex >= sizeof(AnalogCal_t))
+  {
+    _calWriter = NULL;
+    _calSaved = millis();
+  }
 }
+#endif
 
 void AnalogIn::setRange(uint16_t min, uint16_t max)
 {
-  _min = min(min, max);
-  _max = max(min, max);
+  _min = min(min, max) << _osBits;
+  _max = max(min, max) << _osBits;
   if (min == max)
   {
     _min = 0;
-    _max = FULL_SCALE;
+    _max = FULL_SCALE << _osBits;
   } 
   if (_type == unipolar)
   {
@@ -83,11 +567,29 @@ void AnalogIn::setScale(float scale)
   _calcScales();
 }
 
+#if ANALOGIN_FIXED_POINT
+// raw range maps to full Q15 range; since |raw| <= range, raw * k always fits 32 bits
 void AnalogIn::_calcScales()
 {
+  _outScale = _scale / (32767.0 * 32768.0);
   if (_type == unipolar)
   {
-    _scalePos = _scale / (float)(_max - _min);
+    _kPos = (_max == _min) ? 0 : (32767UL << 16) / (_max - _min);
+    _kNeg = 0;
+  }
+  else
+  {
+    _kPos = (_offset == _max) ? 0 : (32767UL << 16) / (_max - _offset);
+    _kNeg = (_offset == _min) ? 0 : (32767UL << 16) / (_offset - _min);
+  }
+  _calcDeadband();
+}
+#else
+void AnalogIn::_calcScales()
+{
+  if (_type == unipolar)
+  {
+    _scalePos = (_max == _min) ? 0 : _scale / (float)(_max - _min);
     _scaleNeg = 0;
   }
   else
@@ -95,4 +597,204 @@ void AnalogIn::_calcScales()
     _scalePos = (_offset == _max) ? 0 : _scale / (float)(_max - _offset);
     _scaleNeg = (_offset == _min) ? 0 : _scale / (float)(_offset - _min);
   }
+  _curveIn = (_scale == 0) ? 0 : 32767.0 / _scale;
+  _curveOut = _scale / 32767.0;
+  _calcDeadband();
+}
+#endif
+
+bool AnalogIn::setDataRef(XPString_t *dataRefName, uint16_t deadband, int index)
+{
+  if (_dataRef == NULL)
+  {
+    AnalogValue_t *dataRef = new AnalogValue_t;
+    int handle = (index < 0) ? XP.registerDataRef(dataRefName, XPL_WRITE, 0, 0, &dataRef->value)
+                             : XP.registerDataRef(dataRefName, XPL_WRITE, 0, 0, &dataRef->value, index);
+    if (handle < 0)
+    {
+      delete dataRef;
+      return false;
+    }
+    _dataRef = dataRef;
+  }
+  float settle = SETTLE_SAMPLES + SETTLE_TIME_CONSTS / _filterConst;
+  _dataRef->value = value();
+  _dataRef->counts = deadband;
+  _dataRef->raw = raw();
+  _dataRef->settle = (settle < 65535.0) ? (uint16_t)settle : 65535;
+  _dataRef->still = _dataRef->settle;
+  _calcDeadband();
+  return true;
+}
+
+// send moves beyond the deadband; a move ending within the deadband is sent when the input reaches a range
+// limit and again once it has rested until the filter settled, so the dataref always gets the final value
+void AnalogIn::_updateDataRef()
+{
+  float value = this->value();
+  int raw = this->raw();
+  bool send = fabs(value - _dataRef->value) > _dataRef->band;
+  if (raw != _dataRef->raw)
+  {
+    _dataRef->raw = raw;
+    _dataRef->still = 0;
+    send |= (raw == (int)_min - (int)_offset || raw == (int)_max - (int)_offset);
+  }
+  else if (_dataRef->still < _dataRef->settle && ++_dataRef->still == _dataRef->settle)
+  {
+    send = true;
+  }
+  if (send)
+  {
+    _dataRef->value = value;
+  }
+}
+
+// deadband in value units, taken from the steeper side of a bipolar input
+void AnalogIn::_calcDeadband()
+{
+  if (_dataRef == NULL)
+  {
+    return;
+  }
+  uint16_t span = _max - _min;
+  if (_type == bipolar && _offset > _min && _offset < _max)
+  {
+    span = min(_max - _offset, _offset - _min);
+  }
+  _dataRef->band = (span == 0) ? 0 : (float)_dataRef->counts * (1 << _osBits) * fabs(_scale) / span;
+}
+
+#ifdef ARDUINO_ARCH_AVR
+void AnalogIn::_selectChannel(uint8_t channel)
+{
+#if defined(MUX5)
+  ADCSRB = (ADCSRB & ~_BV(MUX5)) | (((channel >> 3) & 0x01) << MUX5);
+#endif
+  ADMUX = _BV(REFS0) | (channel & 0x07);      // AVcc reference
+}
+#endif
+
+// inputs are converted in order of channel, a conversion during which the selector pins were switched by
+// DigitalIn (scan interrupt) is repeated up to MUX_RETRIES times, so the digital scan is never held up
+void AnalogIn::handleMux()
+{
+  if (_numMux == 0)
+  {
+    return;
+  }
+#if ANALOGIN_SEQUENCER
+  if (_running)
+  {
+    return;
+  }
+#endif
+#ifdef ARDUINO_ARCH_AVR
+  ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);     // 125 kHz ADC clock at 16 MHz
+  for (uint8_t i = 0; i < _numMux; i++)
+  {
+    AnalogIn *in = _mux[i];
+    uint8_t changes;
+    uint8_t retries = 0;
+    do
+    {
+      // the sample is taken 1.5 ADC clocks after the start, which gives the multiplexer time to settle
+      uint8_t oldSREG = SREG;
+      cli();
+      DigitalIn.setMuxChannel(in->_muxChannel);
+      changes = DigitalIn.muxChanges();
+      SREG = oldSREG;
+      _selectChannel(in->_channel);
+      ADCSRA |= _BV(ADSC);
+      while (ADCSRA & _BV(ADSC));
+    } while (DigitalIn.muxChanges() != changes && retries++ < MUX_RETRIES);
+    if (in->_accumulate(ADC))
+    {
+      in->_fresh = true;
+    }
+  }
+#else
+  for (uint8_t i = 0; i < _numMux; i++)
+  {
+    AnalogIn *in = _mux[i];
+    if (i == 0 || in->_muxChannel != _mux[i - 1]->_muxChannel)
+    {
+      DigitalIn.setMuxChannel(in->_muxChannel);
+    }
+    if (in->_accumulate(analogRead(in->_pin)))
+    {
+      in->_fresh = true;
+    }
+  }
+#endif
+}
+
+#if ANALOGIN_SEQUENCER
+// direct inputs first, then the multiplexed inputs in order of channel
+AnalogIn *AnalogIn::_sequence(uint8_t index)
+{
+  return (index < _numSlots) ? _slot[index] : _mux[index - _numSlots];
+}
+
+// select the input and its multiplexer channel and start a single conversion
+void AnalogIn::_startConversion(AnalogIn *in)
+{
+  if (in->_muxChannel != NOT_USED)
+  {
+    DigitalIn.setMuxChannel(in->_muxChannel);
+    _muxChanges = DigitalIn.muxChanges();
+  }
+  _selectChannel(in->_channel);
+  ADCSRA |= _BV(ADSC);
+}
+
+// single conversions started from the interrupt, so the channel can be switched in between
+bool AnalogIn::startSequencer()
+{
+  if (_numSlots + _numMux == 0)
+  {
+    return false;
+  }
+  _current = 0;
+  _retries = 0;
+  _running = true;
+  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);   // 125 kHz ADC clock at 16 MHz
+  _startConversion(_sequence(0));
+  return true;
+}
+
+void AnalogIn::stopSequencer()
+{
+  ADCSRA &= ~_BV(ADIE);
+  while (ADCSRA & _BV(ADSC));       // let a running conversion complete, analogRead() needs the ADC idle
+  _running = false;
+}
+
+// a multiplexed conversion is repeated (up to MUX_RETRIES times) when DigitalIn switched the selector pins meanwhile
+void AnalogIn::sequencerISR()
+{
+  AnalogIn *in = _sequence(_current);
+  if (in->_muxChannel == NOT_USED || DigitalIn.muxChanges() == _muxChanges || _retries >= MUX_RETRIES)
+  {
+    _retries = 0;
+    if (in->_accumulate(ADC))
+    {
+      in->_fresh = true;
+    }
+    if (++_current >= _numSlots + _numMux)
+    {
+      _current = 0;
+    }
+  }
+  else
+  {
+    _retries++;
+  }
+  _startConversion(_sequence(_current));
+}
+
+ISR(ADC_vect)
+{
+  AnalogIn::sequencerISR();
 }
+#endif
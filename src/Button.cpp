@@ -1,10 +1,6 @@
 #include <XPLDirect.h>
 #include "Button.h"
 
-#ifndef DEBOUNCE_DELAY
-#define DEBOUNCE_DELAY 20
-#endif
-
 // Buttons
 Button::Button(uint8_t nExp, uint8_t pin)
 {
@@ -12,8 +8,9 @@ Button::Button(uint8_t nExp, uint8_t pin)
   _pin = pin;
   _state = 0;
   _transition = 0;
+  _queued = false;
   _cmdPush = -1;
-  if(mux == NOT_USED) {
+  if (_nExp == NOT_USED && _pin != NOT_USED) {
     pinMode(_pin, INPUT_PULLUP);
   }
 }
@@ -21,20 +18,20 @@ Button::Button(uint8_t nExp, uint8_t pin)
 // use additional bit for input masking
 void Button::_handle(bool input)
 {
-  if (DigitalIn.getBit(_nExp, _pin) && input)
+  _update(DigitalIn.getBit(_nExp, _pin) && input);
+  if (_queued)
   {
-    if (_state == 0)
-    {
-      _state = DEBOUNCE_DELAY;
-      _transition = transPressed;
-    }
+    _processCommand(true);
   }
-  else if (_state > 0)
+}
+
+// evaluate debounced state and transitions from current input
+void Button::_update(bool input)
+{
+  uint8_t transition = debouncePush(_state, input);
+  if (transition != transNone)
   {
-    if (--_state == 0)
-    {
-      _transition = transReleased;
-    }
+    _transition = transition;
   }
 }
 
@@ -48,15 +45,15 @@ void Button::setCommand(XPString_t *cmdNamePush)
   _cmdPush = XP.registerCommand(cmdNamePush);
 }
 
-void Button::processCommand()
+void Button::_processCommand(bool queue)
 {
   if (pressed())
   {
-    XP.commandStart(_cmdPush);
+    commandEvent(queue, eventStart, _cmdPush);
   }
   if (released())
   {
-    XP.commandEnd(_cmdPush);
+    commandEvent(queue, eventEnd, _cmdPush);
   }
 }
 
@@ -68,26 +65,241 @@ RepeatButton::RepeatButton(uint8_t nExp, uint8_t pin, uint32_t delay) : Button(n
 
 void RepeatButton::_handle(bool input)
 {
-  if (DigitalIn.getBit(_nExp, _pin) && input)
+  bool wasEngaged = engaged();
+  input = DigitalIn.getBit(_nExp, _pin) && input;
+  _update(input);
+  if (input)
   {
-    if (_state == 0)
+    if (!wasEngaged)
     {
-      _state = DEBOUNCE_DELAY;
-      _transition = transPressed;
       _timer = millis() + _delay;
     }
-    else if (_delay > 0 && (millis() >= _timer))
+    else if (_delay > 0 && (long)(millis() - _timer) >= 0)     // wraparound safe
     {
-      _state = DEBOUNCE_DELAY;
       _transition = transPressed;
       _timer += _delay;
     }
   }
-  else if (_state > 0)
+  if (_queued)
+  {
+    _processCommand(true);
+  }
+}
+
+GestureButton::GestureButton(uint8_t nExp, uint8_t pin, bool doubleClick) : Button(nExp, pin)
+{
+  _gState = gsIdle;
+  _gesture = gestNone;
+  _interval = GESTURE_REPEAT_START;
+  _doubleClick = doubleClick;
+  _stamp = 0;
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    _cmd[i] = -1;
+  }
+}
+
+// gesture state machine on the debounced input, all times relative to the shared time base
+void GestureButton::_handle(bool input)
+{
+  _update(DigitalIn.getBit(_nExp, _pin) && input);
+  uint16_t elapsed = DigitalIn.now() - _stamp;
+  switch (_gState)
+  {
+  case gsIdle:
+    if (engaged())
+    {
+      _stamp = DigitalIn.now();
+      _gState = gsPressed;
+    }
+    break;
+  case gsPressed:
+    if (!engaged())
+    {
+      if (_doubleClick)
+      {
+        _stamp = DigitalIn.now();
+        _gState = gsReleased;
+      }
+      else
+      {
+        _gesture = gestClick;
+        _gState = gsIdle;
+      }
+    }
+    else if (elapsed >= GESTURE_LONG)
+    {
+      _gesture = gestLong;
+      _stamp = DigitalIn.now();
+      _interval = GESTURE_REPEAT_START;
+      _gState = gsRepeat;
+    }
+    break;
+  case gsReleased:
+    if (engaged())
+    {
+      _gesture = gestDouble;
+      _gState = gsHeld;
+    }
+    else if (elapsed >= GESTURE_DOUBLE)
+    {
+      _gesture = gestClick;
+      _gState = gsIdle;
+    }
+    break;
+  case gsRepeat:
+    if (!engaged())
+    {
+      _gState = gsIdle;
+    }
+    else if (elapsed >= _interval)
+    {
+      _gesture = gestRepeat;
+      _stamp += _interval;
+      _interval -= (_interval - GESTURE_REPEAT_MIN + 3) / 4;     // accelerate
+    }
+    break;
+  default:      // gsHeld
+    if (!engaged())
+    {
+      _gState = gsIdle;
+    }
+    break;
+  }
+  if (_queued)
+  {
+    _processCommand(true);
+  }
+}
+
+void GestureButton::setCommand(Gesture_t gesture, int cmd)
+{
+  if (gesture == gestNone)
+  {
+    return;
+  }
+  _cmd[gesture] = cmd;
+  if (gesture == gestDouble)
+  {
+    _doubleClick = true;
+  }
+}
+
+void GestureButton::setCommand(Gesture_t gesture, XPString_t *cmdName)
+{
+  setCommand(gesture, XP.registerCommand(cmdName));
+}
+
+void GestureButton::_processCommand(bool queue)
+{
+  Gesture_t g = gesture();
+  if (g != gestNone && _cmd[g] >= 0)
+  {
+    commandEvent(queue, eventTrigger, _cmd[g]);
+  }
+}
+
+// Button bank
+
+// number of set bits, loop runs once per set bit
+static uint8_t bitCount(uint16_t bits)
+{
+  uint8_t count = 0;
+  while (bits)
+  {
+    bits &= bits - 1;
+    count++;
+  }
+  return count;
+}
+
+ButtonBank::ButtonBank(uint8_t nExp)
+{
+  _nExp = nExp;
+  _engaged = 0;
+  _pressed = 0;
+  _released = 0;
+  memset(_state, 0, sizeof(_state));
+  _queued = false;
+  _cmdMask = 0;
+  _cmdBase = -1;
+}
+
+// each button is debounced on its own like Button, idle channels are skipped with word operations
+void ButtonBank::_update(uint16_t input)
+{
+  uint16_t active = _engaged | input;
+  while (active)
+  {
+    uint8_t channel = lowestBit(active);
+    uint16_t bit = (1U << channel);
+    switch (debouncePush(_state[channel], input & bit))
+    {
+    case 1:
+      _pressed |= bit;
+      _engaged |= bit;
+      break;
+    case 2:
+      _released |= bit;
+      _engaged &= ~bit;
+      break;
+    }
+    active &= active - 1;
+  }
+}
+
+bool ButtonBank::setCommands(const char *const *cmdNames, uint16_t mask)
+{
+  _cmdMask = 0;
+  _cmdBase = -1;
+  uint8_t index = 0;
+  while (mask)
   {
-    if (--_state == 0)
+    uint16_t bit = mask & -mask;
+#ifdef XPL_USE_PROGMEM
+    XPString_t *name = (XPString_t *)pgm_read_ptr(&cmdNames[index]);
+#else
+    XPString_t *name = cmdNames[index];
+#endif
+    int handle = XP.registerCommand(name);
+    if (handle < 0)
+    {
+      return false;
+    }
+    if (_cmdBase < 0)
     {
-      _transition = transReleased;
+      _cmdBase = handle;
     }
+    _cmdMask |= bit;
+    mask &= ~bit;
+    index++;
   }
-}
\ No newline at end of file
+  return true;
+}
+
+// handles are consecutive, so the handle of a channel is the base plus the number of commands below it
+int ButtonBank::getCommand(uint8_t channel)
+{
+  uint16_t bit = (1U << channel);
+  if (!(_cmdMask & bit))
+  {
+    return -1;
+  }
+  return _cmdBase + bitCount(_cmdMask & (bit - 1));
+}
+
+void ButtonBank::_processCommand(bool queue)
+{
+  uint16_t events = pressed() & _cmdMask;
+  while (events)
+  {
+    commandEvent(queue, eventStart, getCommand(lowestBit(events)));
+    events &= events - 1;
+  }
+  events = released() & _cmdMask;
+  while (events)
+  {
+    commandEvent(queue, eventEnd, getCommand(lowestBit(events)));
+    events &= events - 1;
+  }
+}
@@ -1,5 +1,14 @@
 #include "DigitalIn.h"
 
+#if MCP_MAX_NUMBER > 0
+// MCP23017 register addresses (IOCON.BANK = 0, A/B registers interleaved)
+#define MCP_IODIRA   0x00
+#define MCP_IOCON    0x0A
+#define MCP_GPIOA    0x12
+// MCP23017 IOCON bits
+#define MCP_MIRROR   0x40     // INTA/INTB internally connected
+#define MCP_ODR      0x04     // INT outputs open drain (allows wired-OR of several expanders)
+#endif
 
 #ifdef ARDUINO_ARCH_AVR
 // Helper function for quick pin out setting (AVR)
@@ -27,24 +36,56 @@ inline bool directIn(uint8_t pin)
 {
     volatile uint8_t *inReg = portInputRegister(digitalPinToPort(pin));
     uint8_t mask = digitalPinToBitMask(pin);
-    return ((*inReg & mask) == 0);     // Positive logic, will be negated later
+    return ((*inReg & mask) != 0);     // Positive logic, will be negated later
 }
 
 #else
 inline void directOut(uint8_t pin, uint8_t val) { digitalWrite(pin, val); } 
-inline bool directIn(uint8_t pin) { digitalRead(pin) }
+inline bool directIn(uint8_t pin) { return digitalRead(pin); }
 #endif
 
 
 
+// Index of the lowest set bit of a 16 bit word by De Bruijn multiplication: the isolated bit shifts the
+// sequence 0x09AF so that its upper nibble is unique for every bit position. Constant time, unlike a bit loop.
+static const uint8_t _deBruijn16[16] PROGMEM = {0, 1, 2, 5, 3, 9, 6, 11, 15, 4, 8, 10, 14, 7, 13, 12};
+
+uint8_t lowestBit(uint16_t bits)
+{
+  return pgm_read_byte(&_deBruijn16[(uint16_t)((uint16_t)(bits & -bits) * 0x09AFu) >> 12]);
+}
+
 // constructor
 DigitalIn_::DigitalIn_()
 {
   _nExpanders = 0;
-  for (uint8_t nExp = 0; nExp < MUX_MAX_NUMBER; nExp++)
+  _numMux = 0;
+  _muxChanges = 0;
+  _now = 0;
+  _statStart = 0;
+  _loopCount = 0;
+  _loopInterval = 0;
+  for (uint8_t nExp = 0; nExp < EXP_MAX_NUMBER; nExp++)
   {
     _pin[nExp] = NOT_USED;
   }
+#if MCP_MAX_NUMBER > 0
+  _numMCP = 0;
+#endif
+#if DIGITALIN_SCAN_ISR
+  _scanning = false;
+  _seq = 0;
+#endif
+#if SHIFTIN_MAX_NUMBER > 0
+  _numShift = 0;
+  _numShiftWords = 0;
+#endif
+#if MATRIX_MAX_ROWS > 0
+  _numRows = 0;
+  _numCols = 0;
+  _matrixRow = 0;
+  _matrixGhosts = 0;
+#endif
   _s0 = _s1 = _s2 = _s3 = NOT_USED;
   #ifdef ARDUINO_ARCH_AVR
   _s0port = _s1port = _s2port = _s3port = NOT_USED;
@@ -86,8 +127,9 @@ void DigitalIn_::setMuxChannel(uint8_t ch)
   cli();
   preg = portOutputRegister(_s3port); (ch & 0x08) ? (*preg |= _s3mask) : (*preg &= ~_s3mask);
   preg = portOutputRegister(_s2port); (ch & 0x04) ? (*preg |= _s2mask) : (*preg &= ~_s2mask);
-  preg = portOutputRegister(_s3port); (ch & 0x02) ? (*preg |= _s1mask) : (*preg &= ~_s1mask);
+  preg = portOutputRegister(_s1port); (ch & 0x02) ? (*preg |= _s1mask) : (*preg &= ~_s1mask);
   preg = portOutputRegister(_s0port); (ch & 0x01) ? (*preg |= _s0mask) : (*preg &= ~_s0mask);
+  _muxChanges++;
   SREG = oldSREG;
   delayMicroseconds(1);     // Allow signals to settle
 #else
@@ -95,16 +137,18 @@ void DigitalIn_::setMuxChannel(uint8_t ch)
   directOut(_s2, (ch & 0x04));
   directOut(_s1, (ch & 0x02));
   directOut(_s0, (ch & 0x01));
+  _muxChanges++;
 #endif
 }
 
 // Add a 74HC4067
 bool DigitalIn_::addMux(uint8_t pin)
 {
-  if (_nExpanders >= MUX_MAX_NUMBER)
+  if (_numMux >= MUX_MAX_NUMBER || _nExpanders >= EXP_MAX_NUMBER)
   {
     return false;
   }
+  _numMux++;
   _pin[_nExpanders++] = pin;
   pinMode(pin, INPUT);
   return true;
@@ -112,26 +156,265 @@ bool DigitalIn_::addMux(uint8_t pin)
 
 #if MCP_MAX_NUMBER > 0
 // Add a MCP23017
-bool DigitalIn_::addMCP(uint8_t adress)
+bool DigitalIn_::addMCP(uint8_t adress, uint8_t intPin)
 {
-  if (_nExpanders >= MCP_MAX_NUMBER)
+  if (_numMCP >= MCP_MAX_NUMBER || _nExpanders >= EXP_MAX_NUMBER)
   {
     return false;
   }
-  if (!_mcp[_nExpanders].begin_I2C(adress, &Wire))
+  if (!_mcp[_numMCP].begin_I2C(adress, &Wire))
   {
     return false;
   }
-  for (int i = 0; i < 16; i++)
+  if (!setupMCP(adress, intPin != NOT_USED))
   {
-    // TODO: register write iodir = 0xffff, ipol = 0xffff, gppu = 0xffff
-    _mcp[_nExpanders].pinMode(i, INPUT_PULLUP);
+    return false;
   }
+  if (intPin != NOT_USED)
+  {
+    pinMode(intPin, INPUT_PULLUP);
+  }
+  _mcpInt[_numMCP] = intPin;
+  _data[_nExpanders] = _mcp[_numMCP].readGPIOAB();      // initial image, also clears pending interrupt
+  _numMCP++;
   _pin[_nExpanders++] = MCP_PIN;
   return true;
 }
 #endif
 
+#if SHIFTIN_MAX_NUMBER > 0
+// Add a chain of 74HC165
+bool DigitalIn_::addShiftIn(uint8_t pinData, uint8_t pinClock, uint8_t pinLoad, uint8_t chips)
+{
+  uint8_t words = (chips + 1) / 2;
+  if (chips == 0 || _numShiftWords + words > SHIFTIN_MAX_NUMBER || _nExpanders + words > EXP_MAX_NUMBER)
+  {
+    return false;
+  }
+  _numShiftWords += words;
+  ShiftChain_t &chain = _shift[_numShift++];
+  chain.pinData = pinData;
+  chain.pinClock = pinClock;
+  chain.pinLoad = pinLoad;
+  chain.first = _nExpanders;
+  chain.chips = chips;
+  pinMode(pinData, INPUT);
+  pinMode(pinClock, OUTPUT);
+  pinMode(pinLoad, OUTPUT);
+  digitalWrite(pinClock, LOW);
+  digitalWrite(pinLoad, HIGH);
+#ifdef ARDUINO_ARCH_AVR
+  chain.dataPort = digitalPinToPort(pinData);
+  chain.clockPort = digitalPinToPort(pinClock);
+  chain.loadPort = digitalPinToPort(pinLoad);
+  chain.dataMask = digitalPinToBitMask(pinData);
+  chain.clockMask = digitalPinToBitMask(pinClock);
+  chain.loadMask = digitalPinToBitMask(pinLoad);
+#endif
+  while (words-- > 0)
+  {
+    _data[_nExpanders] = 0;
+    _pin[_nExpanders++] = SHIFT_PIN;
+  }
+  return true;
+}
+
+// Read a complete 74HC165 chain; first bit clocked out is D7 of the chip nearest to the Arduino
+void DigitalIn_::readShift(ShiftChain_t &chain, int16_t *data)
+{
+#ifdef ARDUINO_ARCH_AVR
+  volatile uint8_t *dataReg = portInputRegister(chain.dataPort);
+  volatile uint8_t *clockReg = portOutputRegister(chain.clockPort);
+  volatile uint8_t *loadReg = portOutputRegister(chain.loadPort);
+  uint8_t dataMask = chain.dataMask;
+  uint8_t clockMask = chain.clockMask;
+  uint8_t oldSREG = SREG;
+  // latch parallel inputs
+  cli();
+  *loadReg &= ~chain.loadMask;
+  *loadReg |= chain.loadMask;
+  SREG = oldSREG;
+  for (uint8_t chip = 0; chip < chain.chips; chip++)
+  {
+    uint8_t val = 0;
+    // interrupts are only locked for one chip at a time
+    cli();
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      val <<= 1;
+      if ((*dataReg & dataMask) == 0) val |= 1;         // negative logic: GND = 1
+      *clockReg |= clockMask;
+      *clockReg &= ~clockMask;
+    }
+    SREG = oldSREG;
+#else
+  digitalWrite(chain.pinLoad, LOW);
+  digitalWrite(chain.pinLoad, HIGH);
+  for (uint8_t chip = 0; chip < chain.chips; chip++)
+  {
+    uint8_t val = 0;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      val <<= 1;
+      if (digitalRead(chain.pinData) == LOW) val |= 1;
+      digitalWrite(chain.pinClock, HIGH);
+      digitalWrite(chain.pinClock, LOW);
+    }
+#endif
+    uint8_t *word = (uint8_t *)&data[chain.first + (chip >> 1)];
+    word[chip & 0x01] = val;                            // little endian: even chip = channels 0-7
+  }
+}
+#endif
+
+#if MATRIX_MAX_ROWS > 0
+// Add a keyboard matrix, one expander per row
+bool DigitalIn_::addMatrix(const uint8_t *rowPins, uint8_t rows, const uint8_t *colPins, uint8_t cols, uint8_t settle,
+                           uint8_t rowsPerHandle)
+{
+  if (_numRows > 0 || rows == 0 || rows > MATRIX_MAX_ROWS || cols == 0 || cols > MATRIX_MAX_COLS ||
+      _nExpanders + rows > EXP_MAX_NUMBER)
+  {
+    return false;
+  }
+  _numRows = rows;
+  _numCols = cols;
+  _matrixFirst = _nExpanders;
+  _matrixRow = 0;
+  _matrixSettle = settle;
+  _rowsPerHandle = rowsPerHandle;
+  for (uint8_t row = 0; row < rows; row++)
+  {
+    // inactive rows are high impedance; output latch stays low, so activating a row only sets its DDR bit
+    _rowPin[row] = rowPins[row];
+    pinMode(_rowPin[row], INPUT);
+    digitalWrite(_rowPin[row], LOW);
+#ifdef ARDUINO_ARCH_AVR
+    _rowPort[row] = digitalPinToPort(_rowPin[row]);
+    _rowMask[row] = digitalPinToBitMask(_rowPin[row]);
+#endif
+    _matrixScan[row] = 0;
+    _data[_nExpanders] = 0;
+    _pin[_nExpanders++] = MATRIX_PIN;
+  }
+  for (uint8_t col = 0; col < cols; col++)
+  {
+    _colPin[col] = colPins[col];
+    pinMode(_colPin[col], INPUT_PULLUP);
+#ifdef ARDUINO_ARCH_AVR
+    _colPort[col] = digitalPinToPort(_colPin[col]);
+    _colMask[col] = digitalPinToBitMask(_colPin[col]);
+#endif
+  }
+  return true;
+}
+
+// Drive one row low, wait for the columns to settle and read them
+uint16_t DigitalIn_::readRow(uint8_t row)
+{
+  uint16_t cols = 0;
+#ifdef ARDUINO_ARCH_AVR
+  volatile uint8_t *ddr = portModeRegister(_rowPort[row]);
+  uint8_t mask = _rowMask[row];
+  uint8_t oldSREG = SREG;
+  cli();
+  *ddr |= mask;
+  SREG = oldSREG;
+  delayMicroseconds(_matrixSettle);
+  for (uint8_t col = 0; col < _numCols; col++)
+  {
+    if ((*portInputRegister(_colPort[col]) & _colMask[col]) == 0) cols |= (1U << col);
+  }
+  cli();
+  *ddr &= ~mask;
+  SREG = oldSREG;
+#else
+  pinMode(_rowPin[row], OUTPUT);
+  digitalWrite(_rowPin[row], LOW);
+  delayMicroseconds(_matrixSettle);
+  for (uint8_t col = 0; col < _numCols; col++)
+  {
+    if (digitalRead(_colPin[col]) == LOW) cols |= (1U << col);
+  }
+  pinMode(_rowPin[row], INPUT);
+#endif
+  return cols;
+}
+
+// Scan the row budget for this call; after the last row, publish all rows not involved in ghosting
+void DigitalIn_::scanMatrix()
+{
+  uint8_t count = (_rowsPerHandle > 0) ? _rowsPerHandle : _numRows;
+  while (count-- > 0)
+  {
+    _matrixScan[_matrixRow] = readRow(_matrixRow);
+    if (++_matrixRow < _numRows)
+    {
+      continue;
+    }
+    _matrixRow = 0;
+    // two rows sharing two or more pressed columns form a rectangle, one of its corners may be a ghost
+    uint16_t ambiguous = 0;
+    for (uint8_t a = 0; a < _numRows; a++)
+    {
+      for (uint8_t b = a + 1; b < _numRows; b++)
+      {
+        uint16_t common = _matrixScan[a] & _matrixScan[b];
+        if (common & (common - 1))
+        {
+          ambiguous |= (1U << a) | (1U << b);
+        }
+      }
+    }
+    if (ambiguous)
+    {
+      _matrixGhosts++;
+    }
+    for (uint8_t row = 0; row < _numRows; row++)
+    {
+      if (!(ambiguous & (1U << row)))
+      {
+        _data[_matrixFirst + row] = _matrixScan[row];
+      }
+    }
+  }
+}
+#endif
+
+#if MCP_MAX_NUMBER > 0
+// Sequential write IODIRA..GPPUB in one transaction instead of one read-modify-write per pin
+bool DigitalIn_::setupMCP(uint8_t address, bool interrupt)
+{
+  uint8_t intEnable = (interrupt ? 0xFF : 0x00);
+  Wire.beginTransmission(address);
+  Wire.write(MCP_IODIRA);
+  Wire.write(0xFF); Wire.write(0xFF);                   // IODIR:   all inputs
+  Wire.write(0xFF); Wire.write(0xFF);                   // IPOL:    inverted, GND reads as 1
+  Wire.write(intEnable); Wire.write(intEnable);         // GPINTEN: interrupt on change
+  Wire.write(0x00); Wire.write(0x00);                   // DEFVAL:  unused
+  Wire.write(0x00); Wire.write(0x00);                   // INTCON:  compare against previous value
+  Wire.write(MCP_MIRROR | MCP_ODR);                     // IOCON (same register at both addresses)
+  Wire.write(MCP_MIRROR | MCP_ODR);
+  Wire.write(0xFF); Wire.write(0xFF);                   // GPPU:    pullups enabled
+  return (Wire.endTransmission() == 0);
+}
+
+// Read GPIOA/GPIOB in one transaction
+bool DigitalIn_::readMCP(uint8_t address, uint16_t &value)
+{
+  Wire.beginTransmission(address);
+  Wire.write(MCP_GPIOA);
+  Wire.endTransmission(false);
+  if (Wire.requestFrom(address, (uint8_t)2) < 2)
+  {
+    return false;
+  }
+  uint16_t res = Wire.read();
+  value = res | (Wire.read() << 8);
+  return true;
+}
+#endif
+
 // Gets specific input from expander channel; expander number according to initialization order 
 bool DigitalIn_::getBit(uint8_t expander, uint8_t channel, bool direct)
 {
@@ -141,9 +424,21 @@ bool DigitalIn_::getBit(uint8_t expander, uint8_t channel, bool direct)
   // which also have to perform the selector setting
   if (expander != NOT_USED)
   {
-    if(direct && !isMCP(expander)) {
+#if DIGITALIN_SCAN_ISR
+    if(direct && isMux(expander) && !_scanning) {
+#else
+    if(direct && isMux(expander)) {
+#endif
+#ifdef ARDUINO_ARCH_AVR
+      // the analog sequencer may switch the selector pins from its interrupt
+      uint8_t oldSREG = SREG;
+      cli();
+#endif
       setMuxChannel(channel);
       res = !directIn(_pin[expander]);
+#ifdef ARDUINO_ARCH_AVR
+      SREG = oldSREG;
+#endif
     } else {
       res = bitRead(_data[expander], channel);
     }
@@ -153,34 +448,174 @@ bool DigitalIn_::getBit(uint8_t expander, uint8_t channel, bool direct)
   return res;
 }
 
-// read all inputs together -> base for board specific optimization by using byte read
-void DigitalIn_::handle()
+// read multiplexers and shift registers into a data image
+void DigitalIn_::scan(int16_t *data)
 {
   // only if Mux Pins present
-#if MCP_MAX_NUMBER > 0  
-  if (_nExpanders > _numMCP)
-#else
-  if (_nExpanders > 0)
-#endif
+  if (_numMux > 0)
   {
     for (uint8_t channel = 0; channel < 16; channel++)
     {
+#ifdef ARDUINO_ARCH_AVR
+      // selecting and reading one channel is not split by the analog sequencer interrupt
+      uint8_t oldSREG = SREG;
+      cli();
+#endif
       setMuxChannel(channel);
       for (uint8_t expander = 0; expander < _nExpanders; expander++)
       {
-        if (_pin[expander] == MCP_PIN) continue;
-        bitWrite(_data[expander], channel, !directIn(_pin[expander]));
+        if (!isMux(expander)) continue;
+        bitWrite(data[expander], channel, !directIn(_pin[expander]));
       }
+#ifdef ARDUINO_ARCH_AVR
+      SREG = oldSREG;
+#endif
     }
   }
+#if SHIFTIN_MAX_NUMBER > 0
+  for (uint8_t chain = 0; chain < _numShift; chain++)
+  {
+    readShift(_shift[chain], data);
+  }
+#endif
+}
+
+// read all inputs together -> base for board specific optimization by using byte read
+void DigitalIn_::handle()
+{
+  tick();
+#if DIGITALIN_SCAN_ISR
+  if (_scanning)
+  {
+    // copy latest complete scan; the interrupt only writes the other buffer, so the copy
+    // is consistent unless two scans completed meanwhile
+    uint8_t seq;
+    do
+    {
+      seq = _seq;
+      const int16_t *front = _buffer[seq & 0x01];
+      for (uint8_t expander = 0; expander < _nExpanders; expander++)
+      {
+        if (isMux(expander) || _pin[expander] == SHIFT_PIN) _data[expander] = front[expander];
+      }
+    } while ((uint8_t)(_seq - seq) > 1);
+  }
+  else
+#endif
+  {
+    scan(_data);
+  }
+#if MATRIX_MAX_ROWS > 0
+  if (_numRows > 0)
+  {
+    scanMatrix();
+  }
+#endif
 #if MCP_MAX_NUMBER > 0
-  int mcp = 0;
+  uint8_t mcp = 0;
   for (uint8_t expander = 0; expander < _nExpanders; expander++)
   {
     if (_pin[expander] != MCP_PIN) continue;
-    _data[expander] = ~_mcp[mcp++].readGPIOAB();
+    // INT line is active low; without change signalled, the cached image is still valid
+    if (_mcpInt[mcp] == NOT_USED || !directIn(_mcpInt[mcp]))
+    {
+      _data[expander] = _mcp[mcp].readGPIOAB();         // polarity already inverted by IPOL
+    }
+    mcp++;
+  }
+#endif
+}
+
+// one millis() per loop for all devices; the loop interval is averaged over 256 ms
+void DigitalIn_::tick()
+{
+  _now = (uint16_t)millis();
+  _loopCount++;
+  uint16_t elapsed = _now - _statStart;
+  if (elapsed >= 256)
+  {
+    uint32_t interval = (uint32_t)elapsed * 1000 / _loopCount;
+    _loopInterval = (interval > 0xFFFF) ? 0xFFFF : interval;
+    _statStart = _now;
+    _loopCount = 0;
   }
+}
+
+uint32_t DigitalIn_::debounceWindow()
+{
+#if DEBOUNCE_TIME > 0
+  return (uint32_t)DEBOUNCE_TIME * 1000;
+#else
+  return (uint32_t)DEBOUNCE_DELAY * _loopInterval;
 #endif
 }
 
+#if DIGITALIN_SCAN_ISR
+// Setup Timer2 in CTC mode for the requested rate with the smallest possible prescaler
+bool DigitalIn_::startScan(uint16_t rate)
+{
+  static const uint16_t prescaler[] = {1, 8, 32, 64, 128, 256, 1024};
+  if (rate == 0)
+  {
+    return false;
+  }
+  for (uint8_t cs = 0; cs < 7; cs++)
+  {
+    uint32_t top = F_CPU / prescaler[cs] / rate;
+    if (top > 0 && top <= 256)
+    {
+      scan(_buffer[_seq & 0x01]);     // start with a valid front buffer
+      uint8_t oldSREG = SREG;
+      cli();
+      _minInterval = 0xFFFF;
+      _maxInterval = 0;
+      _lastScan = (uint16_t)micros();
+      TCCR2A = _BV(WGM21);
+      TCCR2B = cs + 1;
+      OCR2A = top - 1;
+      TCNT2 = 0;
+      TIMSK2 |= _BV(OCIE2A);
+      _scanning = true;
+      SREG = oldSREG;
+      return true;
+    }
+  }
+  return false;
+}
+
+void DigitalIn_::stopScan()
+{
+  TIMSK2 &= ~_BV(OCIE2A);
+  _scanning = false;
+}
+
+uint16_t DigitalIn_::scanJitter()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t res = (_maxInterval >= _minInterval) ? _maxInterval - _minInterval : 0;
+  _minInterval = 0xFFFF;
+  _maxInterval = 0;
+  SREG = oldSREG;
+  return res;
+}
+
+// Scan into back buffer, then make it the front buffer
+void DigitalIn_::scanISR()
+{
+  uint16_t now = (uint16_t)micros();
+  uint16_t interval = now - _lastScan;
+  _lastScan = now;
+  if (interval < _minInterval) _minInterval = interval;
+  if (interval > _maxInterval) _maxInterval = interval;
+  scan(_buffer[(_seq + 1) & 0x01]);
+  _seq++;
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+  DigitalIn.scanISR();
+}
+#endif
+
 DigitalIn_ DigitalIn;
@@ -1,9 +1,8 @@
 #include <XPLDirect.h>
 #include "Encoder.h"
 
-#ifndef DEBOUNCE_DELAY
-#define DEBOUNCE_DELAY 20
-#endif
+// count change for each transition, indexed by (previous BA << 2) | current BA
+static const int8_t _encTable[16] PROGMEM = {0, 1, -1, 2, -1, 0, -2, 1, 1, -2, 0, -1, 2, -1, 1, 0};
 
 // Encoder with button functionality on MUX
 Encoder::Encoder(uint8_t nExp, uint8_t pin1, uint8_t pin2, uint8_t pin3, EncPulse_t pulses)
@@ -15,11 +14,15 @@ Encoder::Encoder(uint8_t nExp, uint8_t pin1, uint8_t pin2, uint8_t pin3, EncPuls
   _pulses = pulses;
   _count = 0;
   _state = 0;
+  _debounce = 0;
   _transition = transNone;
+  _queued = false;
   _cmdUp = -1;
   _cmdDown = -1;
   _cmdPush = -1;
-  if(mux == NOT_USED) {
+  _accel = NULL;
+  _value = NULL;
+  if (_nExp == NOT_USED && _pin1 != NOT_USED) {
     pinMode(_pin1, INPUT_PULLUP);
     pinMode(_pin2, INPUT_PULLUP);
     if (_pin3 != NOT_USED)
@@ -32,51 +35,37 @@ Encoder::Encoder(uint8_t nExp, uint8_t pin1, uint8_t pin2, uint8_t pin3, EncPuls
 // real time handling
 void Encoder::handle()
 {
-  uint8_t newState = 0;
   // collect new state
   // If MCU direct pins, getBit() performs pin read, not cache read
   // For _nExp values corresponding to I/O expanders: resort to cache read
   // For actual multiplexers: avoid cache read, access multiplexer now
-  newState |= (DigitalIn.getBit(_nExp, _pin2, true) ? 0x02 : 0x00);
-  newState |= (DigitalIn.getBit(_nExp, _pin1, true) ? 0x01 : 0x00);
-  _state = ((_state & 0x03) << 2) | newState;
+  _update(DigitalIn.getBit(_nExp, _pin1, true), DigitalIn.getBit(_nExp, _pin2, true));
 
-  // evaluate state change
-  if (_state == 1 || _state == 7 || _state == 8 || _state == 14)
-  {
-    _count++;
-  }
-  else if (_state == 2 || _state == 4 || _state == 11 || _state == 13)
-  {
-    _count--;
-  }
-  else if (_state == 3 || _state == 12)
+  // optional button functionality
+  if (_pin3 != NOT_USED)
   {
-    _count += 2;
+    _updatePush(DigitalIn.getBit(_nExp, _pin3));
   }
-  else if (_state == 6 || _state == 9)
+  if (_queued)
   {
-    _count -= 2;
+    _processCommand(true);
   }
+}
 
-  // optional button functionality
-  if (_pin3 != NOT_USED)
+// evaluate encoder tracks
+void Encoder::_update(bool inputA, bool inputB)
+{
+  _state = ((_state & 0x03) << 2) | (inputB ? 0x02 : 0x00) | (inputA ? 0x01 : 0x00);
+  _count += (int8_t)pgm_read_byte(&_encTable[_state]);
+}
+
+// evaluate push function
+void Encoder::_updatePush(bool input)
+{
+  uint8_t transition = debouncePush(_debounce, input);
+  if (transition != transNone)
   {
-    if (DigitalIn.getBit(_nExp, _pin3))
-    {
-      if (_debounce == 0)
-      {
-        _debounce = DEBOUNCE_DELAY;
-        _transition = transPressed;
-      }
-    }
-    else if (_debounce > 0)
-    {
-      if (--_debounce == 0)
-      {
-        _transition = transReleased;
-      }
-    }
+    _transition = transition;
   }
 }
 
@@ -127,25 +116,340 @@ int Encoder::getCommand(EncCmd_t cmd)
   }
 }
 
-void Encoder::processCommand()
+void Encoder::setAcceleration(uint8_t slowMs, uint8_t fastMs, uint8_t maxFactor)
 {
-  if (up())
+  if (_accel == NULL)
   {
-    XP.commandTrigger(_cmdUp);
+    _accel = new EncAccel_t;
+    _accel->lastNotch = millis();
   }
-  if (down())
+  _accel->fastMs = min(fastMs, 254);
+  _accel->slowMs = max(slowMs, _accel->fastMs + 1);
+  _accel->maxFactor = max(maxFactor, 1);
+}
+
+void Encoder::setDataRef(float *value, float step, float minValue, float maxValue, bool wrap)
+{
+  if (_value == NULL)
   {
-    XP.commandTrigger(_cmdDown);
+    _value = new EncValue_t;
   }
+  _value->value = value;
+  _value->step = step;
+  _value->min = min(minValue, maxValue);
+  _value->max = max(minValue, maxValue);
+  _value->wrap = wrap;
+}
+
+int16_t Encoder::_takeNotches()
+{
+  int16_t notches = _count / (int8_t)_pulses;
+  _count -= notches * _pulses;
+  return notches;
+}
+
+// Apply acceleration to accumulated notches and send them as one command or value change
+void Encoder::_processNotches(int16_t notches, bool queue)
+{
+  if (notches == 0)
+  {
+    return;
+  }
+  uint16_t steps = abs(notches);
+  if (_accel != NULL)
+  {
+    // average time per notch since the last notch event
+    uint32_t now = millis();
+    uint32_t interval = (now - _accel->lastNotch) / steps;
+    _accel->lastNotch = now;
+    if (interval < _accel->slowMs)
+    {
+      // linear ramp from 1 at slowMs to maxFactor at fastMs
+      uint8_t range = _accel->slowMs - _accel->fastMs;
+      uint8_t speed = _accel->slowMs - max((uint8_t)interval, _accel->fastMs);
+      steps *= 1 + ((_accel->maxFactor - 1) * speed + range / 2) / range;
+    }
+  }
+  if (_value != NULL)
+  {
+    float value = *_value->value + (notches > 0 ? steps : -(float)steps) * _value->step;
+    float span = _value->max - _value->min;
+    if (_value->wrap && span > 0)
+    {
+      while (value >= _value->max) value -= span;
+      while (value < _value->min) value += span;
+    }
+    else
+    {
+      value = constrain(value, _value->min, _value->max);
+    }
+    *_value->value = value;
+  }
+  else
+  {
+    commandEvent(queue, eventTrigger, notches > 0 ? _cmdUp : _cmdDown, steps);
+  }
+}
+
+void Encoder::_processCommand(bool queue)
+{
+  _processNotches(_takeNotches(), queue);
+  _processPush(queue);
+}
+
+void Encoder::_processPush(bool queue)
+{
   if (_cmdPush >= 0)
   {
     if (pressed())
     {
-      XP.commandStart(_cmdPush);
+      commandEvent(queue, eventStart, _cmdPush);
     }
     if (released())
     {
-      XP.commandEnd(_cmdPush);
+      commandEvent(queue, eventEnd, _cmdPush);
+    }
+  }
+}
+
+// Interrupt driven Encoder
+
+IntEncoder *IntEncoder::_instance[ENCODER_INT_MAX];
+uint8_t IntEncoder::_numInstances = 0;
+
+// mask interrupts and restore the previous state afterwards (SREG idiom on AVR)
+static inline uint8_t lockInterrupts()
+{
+#ifdef ARDUINO_ARCH_AVR
+  uint8_t oldSREG = SREG;
+  cli();
+  return oldSREG;
+#else
+  noInterrupts();
+  return 0;
+#endif
+}
+
+static inline void restoreInterrupts(uint8_t oldSREG)
+{
+#ifdef ARDUINO_ARCH_AVR
+  SREG = oldSREG;
+#else
+  interrupts();
+#endif
+}
+
+// one trampoline per instance, as attachInterrupt() takes no argument
+template <uint8_t N>
+static void _intEncoderISR()
+{
+  IntEncoder::_instance[N]->_decode();
+}
+static void (*const _intEncoderISRs[ENCODER_INT_MAX])() = {_intEncoderISR<0>, _intEncoderISR<1>, _intEncoderISR<2>, _intEncoderISR<3>};
+
+IntEncoder::IntEncoder(uint8_t pin1, uint8_t pin2, uint8_t pin3, EncPulse_t pulses) : Encoder(NOT_USED, pin1, pin2, pin3, pulses)
+{
+  _acc = 0;
+  _attached = false;
+#ifdef ARDUINO_ARCH_AVR
+  _inA = portInputRegister(digitalPinToPort(pin1));
+  _inB = portInputRegister(digitalPinToPort(pin2));
+  _maskA = digitalPinToBitMask(pin1);
+  _maskB = digitalPinToBitMask(pin2);
+#endif
+  _decode();      // initial track state
+  _acc = 0;
+  int intA = digitalPinToInterrupt(pin1);
+  int intB = digitalPinToInterrupt(pin2);
+  if (_numInstances < ENCODER_INT_MAX && intA >= 0 && intB >= 0)
+  {
+    _instance[_numInstances] = this;
+    attachInterrupt(intA, _intEncoderISRs[_numInstances], CHANGE);
+    attachInterrupt(intB, _intEncoderISRs[_numInstances], CHANGE);
+    _numInstances++;
+    _attached = true;
+  }
+}
+
+// called from pin interrupt, or from handle() if pins are not interrupt capable
+void IntEncoder::_decode()
+{
+#ifdef ARDUINO_ARCH_AVR
+  uint8_t input = ((*_inB & _maskB) ? 0x00 : 0x02) | ((*_inA & _maskA) ? 0x00 : 0x01);
+#else
+  uint8_t input = (digitalRead(_pin2) ? 0x00 : 0x02) | (digitalRead(_pin1) ? 0x00 : 0x01);
+#endif
+  _state = ((_state & 0x03) << 2) | input;
+  _acc += (int8_t)pgm_read_byte(&_encTable[_state]);
+}
+
+void IntEncoder::handle()
+{
+  if (!_attached)
+  {
+    uint8_t oldSREG = lockInterrupts();
+    _decode();
+    restoreInterrupts(oldSREG);
+  }
+  if (_pin3 != NOT_USED)
+  {
+    _updatePush(DigitalIn.getBit(NOT_USED, _pin3));
+  }
+  if (_queued)
+  {
+    _processCommand(true);
+  }
+}
+
+int16_t IntEncoder::pos()
+{
+  uint8_t oldSREG = lockInterrupts();
+  int16_t res = _acc;
+  restoreInterrupts(oldSREG);
+  return res;
+}
+
+bool IntEncoder::up()
+{
+  bool res = false;
+  uint8_t oldSREG = lockInterrupts();
+  if (_acc >= _pulses)
+  {
+    _acc -= _pulses;
+    res = true;
+  }
+  restoreInterrupts(oldSREG);
+  return res;
+}
+
+bool IntEncoder::down()
+{
+  bool res = false;
+  uint8_t oldSREG = lockInterrupts();
+  if (_acc <= -_pulses)
+  {
+    _acc += _pulses;
+    res = true;
+  }
+  restoreInterrupts(oldSREG);
+  return res;
+}
+
+// all notches accumulated since last call are sent as one command with repeat count
+int16_t IntEncoder::_takeNotches()
+{
+  uint8_t oldSREG = lockInterrupts();
+  int16_t notches = _acc / _pulses;
+  _acc -= notches * _pulses;
+  restoreInterrupts(oldSREG);
+  return notches;
+}
+
+void IntEncoder::_processCommand(bool queue)
+{
+  _processNotches(_takeNotches(), queue);
+  _processPush(queue);
+}
+
+// Encoder bank
+
+EncoderBank::EncoderBank(uint8_t nExp, EncPulse_t pulses)
+{
+  _nExp = nExp;
+  _pulses = pulses;
+  _last = 0;
+  _queued = false;
+  for (uint8_t enc = 0; enc < 8; enc++)
+  {
+    _count[enc] = 0;
+    _cmdUp[enc] = -1;
+    _cmdDown[enc] = -1;
+  }
+}
+
+// decode all encoders in parallel: A tracks on even bits, B tracks on odd bits
+void EncoderBank::handle()
+{
+  uint16_t input = DigitalIn.getWord(_nExp);
+  if (input == _last)
+  {
+    return;
+  }
+  uint16_t a = input & 0x5555;
+  uint16_t b = (input >> 1) & 0x5555;
+  uint16_t a0 = _last & 0x5555;
+  uint16_t b0 = (_last >> 1) & 0x5555;
+  _last = input;
+
+  uint16_t single = (a ^ a0) ^ (b ^ b0);        // exactly one track changed
+  uint16_t twice = (a ^ a0) & (b ^ b0);         // both tracks changed (missed state)
+  uint16_t up = (single & (a ^ b0)) | (twice & ~(a0 ^ b0));
+  uint16_t moved = single | twice;
+  for (uint8_t enc = 0; moved; enc++, moved >>= 2, up >>= 2, twice >>= 2)
+  {
+    if (moved & 0x01)
+    {
+      int8_t step = (twice & 0x01) ? 2 : 1;
+      _count[enc] += (up & 0x01) ? step : -step;
+    }
+  }
+  if (_queued)
+  {
+    _processCommand(true);
+  }
+}
+
+bool EncoderBank::up(uint8_t enc)
+{
+  enc &= 0x07;
+  if (_count[enc] >= _pulses)
+  {
+    _count[enc] -= _pulses;
+    return true;
+  }
+  return false;
+}
+
+bool EncoderBank::down(uint8_t enc)
+{
+  enc &= 0x07;
+  if (_count[enc] <= -_pulses)
+  {
+    _count[enc] += _pulses;
+    return true;
+  }
+  return false;
+}
+
+void EncoderBank::setCommand(uint8_t enc, int cmdUp, int cmdDown)
+{
+  _cmdUp[enc & 0x07] = cmdUp;
+  _cmdDown[enc & 0x07] = cmdDown;
+}
+
+void EncoderBank::setCommand(uint8_t enc, XPString_t *cmdNameUp, XPString_t *cmdNameDown)
+{
+  _cmdUp[enc & 0x07] = XP.registerCommand(cmdNameUp);
+  _cmdDown[enc & 0x07] = XP.registerCommand(cmdNameDown);
+}
+
+// all notches accumulated since last call are sent as one command with repeat count
+void EncoderBank::_processCommand(bool queue)
+{
+  for (uint8_t enc = 0; enc < 8; enc++)
+  {
+    int8_t notches = _count[enc] / (int8_t)_pulses;
+    if (notches != 0)
+    {
+      _count[enc] -= notches * _pulses;
+      if (notches > 0)
+      {
+        commandEvent(queue, eventTrigger, _cmdUp[enc], notches);
+      }
+      else
+      {
+        commandEvent(queue, eventTrigger, _cmdDown[enc], -notches);
+      }
     }
   }
 }
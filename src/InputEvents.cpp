@@ -0,0 +1,109 @@
+#include <XPLDirect.h>
+#include "InputEvents.h"
+
+// keep the compiler from moving event accesses across index updates
+#define EVENT_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+InputEvents_::InputEvents_()
+{
+  _head = 0;
+  _tail = 0;
+  _lost = 0;
+  _maxLatency = 0;
+}
+
+// producer: write the event first, then publish it by advancing the head (single byte, atomic on AVR)
+bool InputEvents_::push(uint8_t type, int cmd, uint16_t count)
+{
+  if (cmd < 0)
+  {
+    return true;
+  }
+  uint8_t head = _head;
+  if ((uint8_t)(head - _tail) >= INPUT_EVENTS_SIZE)
+  {
+    _lost++;
+    return false;
+  }
+  InputEvent_t &event = _events[head & (INPUT_EVENTS_SIZE - 1)];
+  event.time = (uint16_t)millis();
+  event.cmd = cmd;
+  event.count = count;
+  event.type = type;
+  EVENT_BARRIER();
+  _head = head + 1;
+  return true;
+}
+
+// consumer: copy the event first, then release the slot by advancing the tail
+bool InputEvents_::pop(InputEvent_t &event)
+{
+  uint8_t tail = _tail;
+  if (tail == _head)
+  {
+    return false;
+  }
+  EVENT_BARRIER();
+  event = _events[tail & (INPUT_EVENTS_SIZE - 1)];
+  EVENT_BARRIER();
+  _tail = tail + 1;
+  return true;
+}
+
+void InputEvents_::processXP()
+{
+  InputEvent_t event;
+  while (pop(event))
+  {
+    uint16_t latency = (uint16_t)millis() - event.time;
+    if (latency > _maxLatency)
+    {
+      _maxLatency = latency;
+    }
+    send(event.type, event.cmd, event.count);
+  }
+}
+
+void InputEvents_::send(uint8_t type, int cmd, uint16_t count)
+{
+  if (cmd < 0)
+  {
+    return;
+  }
+  switch (type)
+  {
+  case eventStart:
+    XP.commandStart(cmd);
+    break;
+  case eventEnd:
+    XP.commandEnd(cmd);
+    break;
+  default:
+    XP.commandTrigger(cmd, count);
+    break;
+  }
+}
+
+// the producer may be an interrupt, so the 16 bit counter is read with interrupts blocked
+uint16_t InputEvents_::lost()
+{
+#ifdef ARDUINO_ARCH_AVR
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t res = _lost;
+  SREG = oldSREG;
+  return res;
+#else
+  return _lost;
+#endif
+}
+
+uint16_t InputEvents_::maxLatency()
+{
+  uint16_t res = _maxLatency;
+  _maxLatency = 0;
+  return res;
+}
+
+// The central instance for the application
+InputEvents_ InputEvents;
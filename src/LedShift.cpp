@@ -2,84 +2,57 @@
 
 #define BLINK_DELAY 150
 
-LedShift::LedShift(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint8_t pins)
+// planes in order on, fast, medium, slow: the blink phase selects the flashing planes by the bits of led_t
+LedShiftBase::LedShiftBase(uint8_t *planes, uint16_t capacity, ShiftChain_t *chains, uint8_t maxChains,
+                           uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins)
+    : ShiftChains(planes, 4, capacity, chains, maxChains, pin_DAI, pin_DCK, pin_LAT, pins)
 {
-  _count = 0;
   _timer = millis() + BLINK_DELAY;
-  _pin_DAI = pin_DAI;
-  _pin_DCK = pin_DCK;
-  _pin_LAT = pin_LAT;
-  _pins = min(pins, 64);
-  for (int pin = 0; pin < _pins; pin++)
-  {
-   _mode[pin] = ledOff;
-  }
-  pinMode(_pin_DAI, OUTPUT);
-  pinMode(_pin_DCK, OUTPUT);
-  pinMode(_pin_LAT, OUTPUT);
-  digitalWrite(_pin_DAI, LOW);
-  digitalWrite(_pin_DCK, LOW);
-  digitalWrite(_pin_LAT, LOW);
-  _send();
 }
 
-// send data
-void LedShift::_send()
+// set or clear one bit in a plane, true when changed
+static bool setPlane(uint8_t *plane, uint16_t pin, bool set)
 {
-  // get bit masks
-  uint8_t dataPort = digitalPinToPort(_pin_DAI);
-  uint8_t dataMask = digitalPinToBitMask(_pin_DAI);
-  uint8_t clockPort = digitalPinToPort(_pin_DCK);
-  uint8_t clockMask = digitalPinToBitMask(_pin_DCK);
-  uint8_t oldSREG = SREG;
-  noInterrupts();
-  uint8_t val = _count | 0x08;
-  for (uint8_t pin = _pins; pin-- > 0;)
-  {
-    (_mode[pin] & val) > 0 ? *portOutputRegister(dataPort) |= dataMask : *portOutputRegister(dataPort) &= ~dataMask;
-    *portOutputRegister(clockPort) |= clockMask;
-    *portOutputRegister(clockPort) &= ~clockMask;
-  }
-  // latch LAT signal
-  clockPort = digitalPinToPort(_pin_LAT);
-  clockMask = digitalPinToBitMask(_pin_LAT);
-  *portOutputRegister(clockPort) |= clockMask;
-  *portOutputRegister(clockPort) &= ~clockMask;
-  SREG = oldSREG;
+  uint8_t mask = 1 << (pin & 0x07);
+  uint8_t old = plane[pin >> 3];
+  plane[pin >> 3] = set ? (old | mask) : (old & ~mask);
+  return plane[pin >> 3] != old;
 }
 
-void LedShift::setPin(uint8_t pin, led_t mode)
+void LedShiftBase::setPin(uint16_t pin, led_t mode)
 {
   if (pin < _pins)
   {
-    if (_mode[pin] != mode)
+    bool changed = setPlane(_plane, pin, mode & ledOn);
+    changed |= setPlane(_plane + _planeBytes, pin, mode & ledFast);
+    changed |= setPlane(_plane + 2 * _planeBytes, pin, mode & ledMedium);
+    changed |= setPlane(_plane + 3 * _planeBytes, pin, mode & ledSlow);
+    if (changed)
     {
-      _mode[pin] = mode;
       _update = true;
     }
   }
 }
 
-void LedShift::setAll(led_t mode)
+void LedShiftBase::setAll(led_t mode)
 {
-  for (int pin = 0; pin < _pins; pin++)
-  {
-    _mode[pin] = mode;
-  }
+  memset(_plane, (mode & ledOn) ? 0xFF : 0x00, _planeBytes);
+  memset(_plane + _planeBytes, (mode & ledFast) ? 0xFF : 0x00, _planeBytes);
+  memset(_plane + 2 * _planeBytes, (mode & ledMedium) ? 0xFF : 0x00, _planeBytes);
+  memset(_plane + 3 * _planeBytes, (mode & ledSlow) ? 0xFF : 0x00, _planeBytes);
   _update = true;
 }
 
-void LedShift::handle()
+void LedShiftBase::handle()
 {
-  if (millis() >= _timer)
+  if ((long)(millis() - _timer) >= 0)     // wraparound safe
   {
     _timer += BLINK_DELAY;
-    _count = (_count + 1) & 0x07;
+    _phase = (_phase + 1) & 0x07;
     _update = true;
   }
-  if (_update)
+  if (_update && _send())
   {
-    _send();
     _update = false;
   }
 }
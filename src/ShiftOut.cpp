@@ -1,12 +1,103 @@
 #include <Arduino.h>
 #include "ShiftOut.h"
+#if SHIFTOUT_SPI
+#include <SPI.h>
 
-ShiftOut::ShiftOut(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint8_t pins)
+bool ShiftSPI_::send(ShiftChains *chain, uint8_t pinLatch)
 {
+  uint16_t bytes = (chain->_chain[0].pins + 7) >> 3;
+  if (_busy || bytes == 0)
+  {
+    return false;
+  }
+  if (!_begun)
+  {
+    SPI.begin();
+    _begun = true;
+  }
+  for (uint8_t index = 0; index < bytes; index++)
+  {
+    _frame[index] = chain->_chainByte(0, index);
+  }
+  _latchReg = portOutputRegister(digitalPinToPort(pinLatch));
+  _latchMask = digitalPinToBitMask(pinLatch);
+  bool enabled = SREG & _BV(SREG_I);
+  SPI.beginTransaction(SPISettings(SHIFTOUT_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  if (enabled && !(SREG & _BV(SREG_I)))
+  {
+    // another SPI user registered with SPI.usingInterrupt() for a non-maskable interrupt, so the transaction
+    // blocks all interrupts and SPI_STC_vect cannot run: send the frame at once
+    for (uint8_t index = bytes; index-- > 0;)
+    {
+      SPI.transfer(_frame[index]);
+    }
+    *_latchReg |= _latchMask;
+    *_latchReg &= ~_latchMask;
+    SPI.endTransaction();
+    return true;
+  }
+  _busy = true;
+  _remaining = bytes - 1;
+  SPCR |= _BV(SPIE);
+  SPDR = _frame[bytes - 1];
+  return true;
+}
+
+void ShiftSPI_::isr()
+{
+  if (_remaining > 0)
+  {
+    SPDR = _frame[--_remaining];
+    return;
+  }
+  // latch LAT signal
+  *_latchReg |= _latchMask;
+  *_latchReg &= ~_latchMask;
+  SPCR &= ~_BV(SPIE);
+  SPI.endTransaction();
+  _busy = false;
+}
+
+ISR(SPI_STC_vect)
+{
+  ShiftSPI.isr();
+}
+
+ShiftSPI_ ShiftSPI;
+#endif
+
+// Chains of shift registers
+ShiftChains::ShiftChains(uint8_t *planes, uint8_t numPlanes, uint16_t capacity, ShiftChain_t *chains,
+                         uint8_t maxChains, uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins)
+{
+  _plane = planes;
+  _numPlanes = numPlanes;
+  _phase = 0;
+  _planeBytes = (capacity + 7) >> 3;
+  memset(_plane, 0, _planeBytes * _numPlanes);
+  _chain = chains;
+  _maxChains = maxChains;
+  _numChains = 1;
+  _chain[0].first = 0;
+  _chain[0].pins = min(pins, capacity);
+  _chain[0].mask = digitalPinToBitMask(pin_DAI);
+  _pins = _chain[0].pins;
   _pin_DAI = pin_DAI;
   _pin_DCK = pin_DCK;
   _pin_LAT = pin_LAT;
-  _pins = min(pins, 64);
+  _update = false;
+#if SHIFTOUT_SPI
+  if (_pin_DAI == SPI_PIN)
+  {
+    // SPI is set up with the first transfer in handle()
+    _chain[0].pins = min(_chain[0].pins, SHIFTOUT_SPI_MAX_BYTES * 8);
+    _pins = _chain[0].pins;
+    pinMode(_pin_LAT, OUTPUT);
+    digitalWrite(_pin_LAT, LOW);
+    _update = true;
+    return;
+  }
+#endif
   pinMode(_pin_DAI, OUTPUT);
   pinMode(_pin_DCK, OUTPUT);
   pinMode(_pin_LAT, OUTPUT);
@@ -16,56 +107,153 @@ ShiftOut::ShiftOut(uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint8_t pi
   _send();
 }
 
-// send data
-void ShiftOut::_send()
+int ShiftChains::addChain(uint8_t pin_DAI, uint16_t pins)
+{
+#if SHIFTOUT_SPI
+  if (_pin_DAI == SPI_PIN)
+  {
+    return -1;
+  }
+#endif
+  ShiftChain_t &last = _chain[_numChains - 1];
+  uint16_t first = last.first + ((last.pins + 7) >> 3);
+  if (_numChains >= _maxChains || first + ((pins + 7) >> 3) > _planeBytes ||
+      digitalPinToPort(pin_DAI) != digitalPinToPort(_pin_DAI))
+  {
+    return -1;
+  }
+  ShiftChain_t &chain = _chain[_numChains++];
+  chain.first = first;
+  chain.pins = pins;
+  chain.mask = digitalPinToBitMask(pin_DAI);
+  _pins = (first << 3) + pins;
+  pinMode(pin_DAI, OUTPUT);
+  digitalWrite(pin_DAI, LOW);
+  _update = true;
+  return first << 3;
+}
+
+// output byte from the planes shown in the current phase
+uint8_t ShiftChains::_byte(uint16_t index)
 {
+  uint8_t bits = _plane[index];
+  uint8_t *plane = _plane;
+  for (uint8_t n = 1; n < _numPlanes; n++)
+  {
+    plane += _planeBytes;
+    if (_phase & (1 << (n - 1)))
+    {
+      bits |= plane[index];
+    }
+  }
+  return bits;
+}
+
+// output byte of a chain, zero above the last output so shorter chains are padded
+uint8_t ShiftChains::_chainByte(uint8_t chain, uint16_t index)
+{
+  ShiftChain_t &c = _chain[chain];
+  uint16_t bytes = (c.pins + 7) >> 3;
+  if (index >= bytes)
+  {
+    return 0;
+  }
+  uint8_t bits = _byte(c.first + index);
+  if (index == bytes - 1 && (c.pins & 0x07))
+  {
+    bits &= (1 << (c.pins & 0x07)) - 1;
+  }
+  return bits;
+}
+
+// send data, highest byte first, all chains clocked together; false when the SPI interface is busy
+bool ShiftChains::_send()
+{
+#if SHIFTOUT_SPI
+  if (_pin_DAI == SPI_PIN)
+  {
+    return ShiftSPI.send(this, _pin_LAT);
+  }
+#endif
   // get bit masks
-  uint8_t dataPort = digitalPinToPort(_pin_DAI);
-  uint8_t dataMask = digitalPinToBitMask(_pin_DAI);
-  uint8_t clockPort = digitalPinToPort(_pin_DCK);
+  volatile uint8_t *dataReg = portOutputRegister(digitalPinToPort(_pin_DAI));
+  volatile uint8_t *clockReg = portOutputRegister(digitalPinToPort(_pin_DCK));
   uint8_t clockMask = digitalPinToBitMask(_pin_DCK);
-  uint8_t oldSREG = SREG;
-  noInterrupts();
-  for (uint8_t pin = _pins; pin-- > 0;)
+  uint8_t dataMask = 0;
+  uint16_t bytes = 0;
+  for (uint8_t c = 0; c < _numChains; c++)
+  {
+    uint16_t chainBytes = (_chain[c].pins + 7) >> 3;
+    dataMask |= _chain[c].mask;
+    if (chainBytes > bytes)
+    {
+      bytes = chainBytes;
+    }
+  }
+  uint8_t data[8];
+  for (uint16_t index = bytes; index-- > 0;)
   {
-    bitRead(_state[pin >> 3], pin & 0x07) ? *portOutputRegister(dataPort) |= dataMask : *portOutputRegister(dataPort) &= ~dataMask;
-    *portOutputRegister(clockPort) |= clockMask;
-    *portOutputRegister(clockPort) &= ~clockMask;
+    for (uint8_t c = 0; c < _numChains; c++)
+    {
+      data[c] = _chainByte(c, index);
+    }
+    // interrupts are blocked for one byte only
+    uint8_t oldSREG = SREG;
+    noInterrupts();
+    uint8_t rest = *dataReg & ~dataMask;
+    for (uint8_t bit = 0x80; bit; bit >>= 1)
+    {
+      uint8_t out = rest;
+      for (uint8_t c = 0; c < _numChains; c++)
+      {
+        if (data[c] & bit) out |= _chain[c].mask;
+      }
+      *dataReg = out;
+      *clockReg |= clockMask;
+      *clockReg &= ~clockMask;
+    }
+    SREG = oldSREG;
   }
   // latch LAT signal
-  clockPort = digitalPinToPort(_pin_LAT);
+  clockReg = portOutputRegister(digitalPinToPort(_pin_LAT));
   clockMask = digitalPinToBitMask(_pin_LAT);
-  *portOutputRegister(clockPort) |= clockMask;
-  *portOutputRegister(clockPort) &= ~clockMask;
+  uint8_t oldSREG = SREG;
+  noInterrupts();
+  *clockReg |= clockMask;
+  *clockReg &= ~clockMask;
   SREG = oldSREG;
+  return true;
+}
+
+// Shift register outputs
+ShiftOutBase::ShiftOutBase(uint8_t *state, uint16_t capacity, ShiftChain_t *chains, uint8_t maxChains,
+                           uint8_t pin_DAI, uint8_t pin_DCK, uint8_t pin_LAT, uint16_t pins)
+    : ShiftChains(state, 1, capacity, chains, maxChains, pin_DAI, pin_DCK, pin_LAT, pins)
+{
 }
 
-void ShiftOut::setPin(uint8_t pin, bool state)
+void ShiftOutBase::setPin(uint16_t pin, bool state)
 {
   if (pin < _pins)
   {
-    if (state != bitRead(_state[pin >> 3], pin & 0x07))
+    if (state != bitRead(_plane[pin >> 3], pin & 0x07))
     {
-      bitWrite(_state[pin >> 3], pin & 0x07, state);
+      bitWrite(_plane[pin >> 3], pin & 0x07, state);
       _update = true;
     }
   }
 }
 
-void ShiftOut::setAll(bool state)
+void ShiftOutBase::setAll(bool state)
 {
-  for (int pin = 0; pin < _pins; pin++)
-  {
-    bitWrite(_state[pin >> 3], pin & 0x07, state);
-  }
+  memset(_plane, state ? 0xFF : 0x00, _planeBytes);
   _update = true;
 }
 
-void ShiftOut::handle()
+void ShiftOutBase::handle()
 {
-  if (_update)
+  if (_update && _send())
   {
-    _send();
     _update = false;
   }
 }
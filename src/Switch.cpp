@@ -1,48 +1,88 @@
 #include <XPLDirect.h>
 #include "Switch.h"
 
-#ifndef DEBOUNCE_DELAY
-#define DEBOUNCE_DELAY 20
-#endif
+// allocate the value of a switch bound to a dataref and register it for writing
+static SwitchValue_t *registerSwitchValue(XPString_t *dataRefName, int index)
+{
+  SwitchValue_t *value = new SwitchValue_t;
+  value->value = 0.0;
+  int handle = (index < 0) ? XP.registerDataRef(dataRefName, XPL_WRITE, 0, 0, &value->value)
+                           : XP.registerDataRef(dataRefName, XPL_WRITE, 0, 0, &value->value, index);
+  if (handle < 0)
+  {
+    delete value;
+    return NULL;
+  }
+  return value;
+}
 
 Switch::Switch(uint8_t nExp, uint8_t pin)
 {
   _nExp = nExp;
   _pin = pin;
   _state = switchOff;
+  _debounce = 0;
+  _transition = false;
+  _queued = false;
   _cmdOn = -1;
+  _value = NULL;
   _cmdOff = -1;
-  if(mux == NOT_USED) {
+  if (_nExp == NOT_USED && _pin != NOT_USED) {
     pinMode(_pin, INPUT_PULLUP);
   }
 }
 
 void Switch::handle()
 {
-  if (_debounce > 0)
+  if (!debouncing(_debounce))
   {
-    _debounce--;
+    _update(DigitalIn.getBit(_nExp, _pin));
   }
-  else 
+}
+
+void Switch::_update(bool input)
+{
+  SwState_t state = (input ? switchOn : switchOff);
+  if (state != _state)
   {
-    SwState_t input = (DigitalIn.getBit(_nExp, _pin) ? switchOn : switchOff);
-    if (input != _state)
+    debounceStart(_debounce);
+    _state = state;
+    _transition = true;
+    if (_value)
     {
-      _debounce = DEBOUNCE_DELAY;
-      _state = input;
-      _transition = true;
+      _value->value = _value->pos[_state];
+    }
+    if (_queued)
+    {
+      _processCommand(true);
     }
   }
 }
 
-void Switch::processCommand()
+bool Switch::setDataRef(XPString_t *dataRefName, float onValue, float offValue, int index)
+{
+  if (_value == NULL)
+  {
+    _value = registerSwitchValue(dataRefName, index);
+    if (_value == NULL)
+    {
+      return false;
+    }
+  }
+  _value->pos[switchOff] = offValue;
+  _value->pos[switchOn] = onValue;
+  _value->value = _value->pos[_state];
+  return true;
+}
+
+void Switch::_processCommand(bool queue)
 {
   if (_transition)
   {
     int cmd = getCommand();
     if (cmd >= 0)
     {
-      XP.commandTrigger(getCommand());
+      commandEvent(queue, eventTrigger, getCommand());
     }
     _transition = false;
   }
@@ -56,6 +96,11 @@ Switch2::Switch2(uint8_t nExp, uint8_t pin1, uint8_t pin2)
   _pin1 = pin1;
   _pin2 = pin2;
   _state = switchOff;
+  _lastState = switchOff;
+  _debounce = 0;
+  _transition = false;
+  _queued = false;
+  _value = NULL;
   _cmdOff = -1;
   _cmdOn1 = -1;
   _cmdOn2 = -1;
@@ -68,11 +113,7 @@ Switch2::Switch2(uint8_t nExp, uint8_t pin1, uint8_t pin2)
 
 void Switch2::handle()
 {
-  if (_debounce > 0)
-  {
-    _debounce--;
-  }
-  else
+  if (!debouncing(_debounce))
   {
     SwState_t input = switchOff;
     if (DigitalIn.getBit(_nExp, _pin1))
@@ -85,14 +126,39 @@ void Switch2::handle()
     }
     if (input != _state)
     {
-      _debounce = DEBOUNCE_DELAY;
+      debounceStart(_debounce);
       _lastState = _state;
       _state = input;
       _transition = true;
+      if (_value)
+      {
+        _value->value = _value->pos[_state];
+      }
+      if (_queued)
+      {
+        _processCommand(true);
+      }
     }
   }
 }
 
+bool Switch2::setDataRef(XPString_t *dataRefName, float on1Value, float offValue, float on2Value, int index)
+{
+  if (_value == NULL)
+  {
+    _value = registerSwitchValue(dataRefName, index);
+    if (_value == NULL)
+    {
+      return false;
+    }
+  }
+  _value->pos[switchOff] = offValue;
+  _value->pos[switchOn1] = on1Value;
+  _value->pos[switchOn2] = on2Value;
+  _value->value = _value->pos[_state];
+  return true;
+}
+
 int Switch2::getCommand()
 {
   int res = -1;
@@ -135,11 +201,138 @@ int Switch2::getCommand()
   return res;
 }
 
-void Switch2::processCommand()
+void Switch2::_processCommand(bool queue)
 {
   if (_transition)
   {
-    XP.commandTrigger(getCommand());
+    commandEvent(queue, eventTrigger, getCommand());
+    _transition = false;
+  }
+}
+
+// Rotary switch
+
+RotarySwitch::RotarySwitch(uint8_t nExp, uint8_t firstChannel, uint8_t positions)
+{
+  _nExp = nExp;
+  // all positions on one expander word, keeps the shifts in _update() defined
+  _first = min(firstChannel, 14);
+  _positions = constrain(positions, 2, 16 - _first);
+  _pos = 0;
+  _lastPos = 0;
+  _debounce = 0;
+  _transition = false;
+  _queued = false;
+  _valid = false;
+  _cmdUp = -1;
+  _cmdDown = -1;
+  _cmdPos = NULL;
+  _values = NULL;
+  _value = NULL;
+}
+
+void RotarySwitch::handle()
+{
+  if (!debouncing(_debounce))
+  {
+    _update(DigitalIn.getWord(_nExp));
+  }
+}
+
+// decode position from expander word, no contact (between detents) keeps the last position,
+// the first position read is taken as start position without a transition
+void RotarySwitch::_update(uint16_t input)
+{
+  uint16_t bits = (input >> _first) & (uint16_t)((1UL << _positions) - 1);
+  if (bits == 0)
+  {
+    return;
+  }
+  uint8_t pos = lowestBit(bits);
+  if (!_valid)
+  {
+    _pos = pos;
+    _lastPos = pos;
+    _valid = true;
+    if (_value)
+    {
+      *_value = _values ? _values[_pos] : _pos;
+    }
+    return;
+  }
+  if (pos != _pos)
+  {
+    debounceStart(_debounce);
+    if (!_transition)
+    {
+      _lastPos = _pos;      // keep start position until processed
+    }
+    _pos = pos;
+    _transition = true;
+    if (_value)
+    {
+      *_value = _values ? _values[_pos] : _pos;
+    }
+    if (_queued)
+    {
+      _processCommand(true);
+    }
+  }
+}
+
+bool RotarySwitch::setPositionCommand(uint8_t pos, int cmd)
+{
+  if (pos >= _positions)
+  {
+    return false;
+  }
+  if (_cmdPos == NULL)
+  {
+    _cmdPos = new int[_positions];
+    for (uint8_t i = 0; i < _positions; i++)
+    {
+      _cmdPos[i] = -1;
+    }
+  }
+  _cmdPos[pos] = cmd;
+  return true;
+}
+
+bool RotarySwitch::setDataRef(XPString_t *dataRefName, const float *values, int index)
+{
+  if (_value == NULL)
+  {
+    float *value = new float;
+    int handle = (index < 0) ? XP.registerDataRef(dataRefName, XPL_WRITE, 0, 0, value)
+                             : XP.registerDataRef(dataRefName, XPL_WRITE, 0, 0, value, index);
+    if (handle < 0)
+    {
+      delete value;
+      return false;
+    }
+    _value = value;
+  }
+  _values = values;
+  *_value = _values ? _values[_pos] : _pos;
+  return true;
+}
+
+void RotarySwitch::_processCommand(bool queue)
+{
+  if (_transition)
+  {
+    if (_cmdPos && _cmdPos[_pos] >= 0)
+    {
+      commandEvent(queue, eventTrigger, _cmdPos[_pos]);
+    }
+    else if (_pos > _lastPos && _cmdUp >= 0)
+    {
+      commandEvent(queue, eventTrigger, _cmdUp, _pos - _lastPos);
+    }
+    else if (_pos < _lastPos && _cmdDown >= 0)
+    {
+      commandEvent(queue, eventTrigger, _cmdDown, _lastPos - _pos);
+    }
     _transition = false;
   }
 }
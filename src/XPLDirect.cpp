@@ -41,7 +41,7 @@ int XPLDirect::xloop(void)
         switch (_dataRefs[i]->dataRefVARType)
         {
         case XPL_DATATYPE_INT:
-          if (*(long int *)_dataRefs[i]->latestValue != _dataRefs[i]->lastSentIntValue)
+          if (*(long int *)_dataRefs[i]->latestValue != _dataRefs[i]->lastSentIntValue || _dataRefs[i]->forceUpdate)
           {
             _sendPacketInt(XPLCMD_DATAREFUPDATE, _dataRefs[i]->dataRefHandle, *(long int *)_dataRefs[i]->latestValue);
             _dataRefs[i]->lastSentIntValue = *(long int *)_dataRefs[i]->latestValue;
@@ -54,7 +54,7 @@ int XPLDirect::xloop(void)
           {
             *(float *)_dataRefs[i]->latestValue = ((int)(*(float *)_dataRefs[i]->latestValue / _dataRefs[i]->divider) * _dataRefs[i]->divider);
           }
-          if (*(float *)_dataRefs[i]->latestValue != _dataRefs[i]->lastSentFloatValue)
+          if (*(float *)_dataRefs[i]->latestValue != _dataRefs[i]->lastSentFloatValue || _dataRefs[i]->forceUpdate)
           {
             _sendPacketFloat(XPLCMD_DATAREFUPDATE, _dataRefs[i]->dataRefHandle, *(float *)_dataRefs[i]->latestValue);
             _dataRefs[i]->lastSentFloatValue = *(float *)_dataRefs[i]->latestValue;
@@ -267,6 +267,7 @@ void XPLDirect::_processPacket()
       {
         _dataRefs[i]->dataRefHandle = _getHandleFromFrame(); // parse the refhandle
         _dataRefs[i]->updatedFlag = true;
+        _dataRefs[i]->forceUpdate = 1; // send current state of write datarefs on connect
         i = _dataRefsCount; // end checking
       }
     }
@@ -476,6 +477,7 @@ int XPLDirect::registerDataRef(XPString_t *datarefName, int rwmode, unsigned int
   _dataRefs[_dataRefsCount]->lastSentIntValue = 0;
   _dataRefs[_dataRefsCount]->arrayIndex = 0;     // not used unless we are referencing an array
   _dataRefs[_dataRefsCount]->dataRefHandle = -1; // invalid until assigned by xplane
+  _dataRefs[_dataRefsCount]->forceUpdate = 0;
   _dataRefsCount++;
   _allDataRefsRegistered = 0;
   return (_dataRefsCount - 1);
@@ -497,6 +499,7 @@ int XPLDirect::registerDataRef(XPString_t *datarefName, int rwmode, unsigned int
   _dataRefs[_dataRefsCount]->lastSentIntValue = 0;
   _dataRefs[_dataRefsCount]->arrayIndex = index; // not used unless we are referencing an array
   _dataRefs[_dataRefsCount]->dataRefHandle = -1; // invalid until assigned by xplane
+  _dataRefs[_dataRefsCount]->forceUpdate = 0;
   _dataRefsCount++;
   _allDataRefsRegistered = 0;
   return (_dataRefsCount - 1);
@@ -518,6 +521,7 @@ int XPLDirect::registerDataRef(XPString_t *datarefName, int rwmode, unsigned int
   _dataRefs[_dataRefsCount]->divider = divider;
   _dataRefs[_dataRefsCount]->arrayIndex = 0;     // not used unless we are referencing an array
   _dataRefs[_dataRefsCount]->dataRefHandle = -1; // invalid until assigned by xplane
+  _dataRefs[_dataRefsCount]->forceUpdate = 0;
   _dataRefsCount++;
   _allDataRefsRegistered = 0;
   return (_dataRefsCount - 1);
@@ -538,6 +542,7 @@ int XPLDirect::registerDataRef(XPString_t *datarefName, int rwmode, unsigned int
   _dataRefs[_dataRefsCount]->updateRate = rate;
   _dataRefs[_dataRefsCount]->arrayIndex = index; // not used unless we are referencing an array
   _dataRefs[_dataRefsCount]->dataRefHandle = -1; // invalid until assigned by xplane
+  _dataRefs[_dataRefsCount]->forceUpdate = 0;
   _dataRefsCount++;
   _allDataRefsRegistered = 0;
   return (_dataRefsCount - 1);
@@ -558,6 +563,7 @@ int XPLDirect::registerDataRef(XPString_t *datarefName, int rwmode, unsigned int
   _dataRefs[_dataRefsCount]->lastSentIntValue = 0;
   _dataRefs[_dataRefsCount]->arrayIndex = 0;     // not used unless we are referencing an array
   _dataRefs[_dataRefsCount]->dataRefHandle = -1; // invalid until assigned by xplane
+  _dataRefs[_dataRefsCount]->forceUpdate = 0;
   _dataRefsCount++;
   _allDataRefsRegistered = 0;
   return (_dataRefsCount - 1);